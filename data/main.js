@@ -1 +1 @@
-function autoRefresh(){$(".info").load("info_box.html"),setTimeout(function(){$(".switch").load("switch_box.html")},20)}function loadConfig(){$(".config").load("config_box.html")}function loadSideNav(){$("nav").load("sidenav.html")}setInterval("autoRefresh()",1e3);
\ No newline at end of file
+function autoRefresh(){$(".info").load("info_box.html"),setTimeout(function(){$(".switch").load("switch_box.html")},20)}function loadConfig(){$(".config").load("config_box.html")}function loadSideNav(){$("nav").load("sidenav.html")}function setMode(e){$.get("mode",e)}setInterval("autoRefresh()",1e3);
\ No newline at end of file
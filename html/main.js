@@ -8,4 +8,7 @@ function loadConfig(){
 function loadSideNav(){
     $("nav").load("sidenav.html");
 }
+function setMode(params){
+    $.get("mode", params);
+}
 setInterval('autoRefresh()', 1000); // refresh every 1000 ms
\ No newline at end of file
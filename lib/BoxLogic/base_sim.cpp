@@ -0,0 +1,308 @@
+#include "base_sim.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "predict.h"
+
+const servo_model sim_sg90 = {20, 0.15, 0};
+
+void sim_default_model(box_model &m){
+  m.rot = m.push = m.lid = sim_sg90;
+  m.contact = 1830;
+}
+
+double sim_travel(const servo_model &m, int dist){
+  if(dist < 0){dist = -dist;}
+  return dist ? m.dead + m.per_us*dist : 0;
+}
+
+//workload ------------------------------------------------------------
+
+uint32_t sim_rng(uint32_t &state){
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+uint32_t sim_range(uint32_t &state, uint32_t lo, uint32_t hi){
+  return lo + sim_rng(state) % (hi - lo + 1);
+}
+
+void sim_add_touch(sim_workload &w, int pos, uint32_t start, uint32_t end, bool pass){
+  if(board_touch_pins[pos] == TOUCH_NONE){return;}
+  std::vector<sim_touch> &v = w.touch[pos];
+  if(!v.empty() && start <= v.back().end){
+    if(end > v.back().end){v.back().end = end;}
+    return;
+  }
+  sim_touch t = {start, end, pass};
+  v.push_back(t);
+}
+
+void sim_synthetic(sim_workload &w, int count, const int *weights, uint32_t &rng_state){
+  static const int skew[4] = {10, 5, 3, 1};
+  int weight[SWITCH_COUNT], total = 0;
+  for(int i=0; i<SWITCH_COUNT; i++){
+    weight[i] = weights ? weights[i] : i < 4 ? skew[i] : 1;
+    total += weight[i];
+  }
+  uint32_t t = 10000;
+  while((int)w.flips.size() < count){
+    int session = sim_range(rng_state, 1, 8);
+    for(int k=0; k<session && (int)w.flips.size() < count; k++){
+      int r = sim_rng(rng_state) % total;
+      uint8_t pos = 0;
+      while(r >= weight[pos]){r -= weight[pos++];}
+      if(sim_rng(rng_state) % 4){
+        sim_add_touch(w, pos, t - sim_range(rng_state, 200, 3000), t + sim_range(rng_state, 0, 400));
+      }
+      sim_flip f = {t, pos};
+      w.flips.push_back(f);
+      t += sim_range(rng_state, 1500, 3500);
+    }
+    if(sim_rng(rng_state) % 3 == 0){
+      uint32_t start = t + sim_range(rng_state, 2000, 10000);
+      sim_add_touch(w, sim_rng(rng_state) % SWITCH_COUNT, start, start + sim_range(rng_state, 300, 2500), true);
+    }
+    t += sim_range(rng_state, 20000, 120000);
+  }
+}
+
+void sim_trace_init(sim_trace &t, sim_workload &w, uint16_t th){
+  memset(&t, 0, sizeof(t));
+  t.w = &w;
+  t.th = th;
+}
+
+void sim_trace_sample(sim_trace &t, uint32_t time, switchmap_t switches, const uint16_t *touch){
+  for(int i=0; i<SWITCH_COUNT; i++){
+    if(touch[i] <= 5){continue;}
+    bool touched = touch[i] < t.th;
+    if(touched && !t.touched[i]){t.since[i] = time;}
+    if(!touched && t.touched[i]){sim_add_touch(*t.w, i, t.since[i], time);}
+    t.touched[i] = touched;
+  }
+  switchmap_t on = switches & ~t.last;
+  for(int i=0; i<SWITCH_COUNT; i++){
+    if((on>>(SWITCH_COUNT-1-i)) & 1){
+      sim_flip f = {time, (uint8_t)i};
+      t.w->flips.push_back(f);
+    }
+  }
+  t.last = switches;
+}
+
+//simulation ----------------------------------------------------------
+
+struct sim {
+  const sim_workload *w;
+  const motion_profile *p;
+  const box_model *m;
+  uint32_t now;
+  int rot;
+  bool lid;
+  int push;
+  bool passing;
+  switchmap_t switches;
+  uint32_t since[SWITCH_COUNT];
+  size_t cursor[SWITCH_COUNT];
+  std::vector<uint32_t> latency;
+  double servo_ms, wasted_ms;
+  uint32_t rotations;
+};
+
+// 1 + seconds touched like touch_update(), 0 if free
+static uint16_t touch_status(sim &s, int pos){
+  const std::vector<sim_touch> &v = s.w->touch[pos];
+  size_t &c = s.cursor[pos];
+  while(c < v.size() && v[c].end <= s.now){c++;}
+  if(c < v.size() && v[c].start <= s.now){return 1 + (s.now - v[c].start)/1000;}
+  return 0;
+}
+
+// next time the status of pos changes
+static uint32_t touch_next(sim &s, int pos){
+  touch_status(s, pos);
+  const std::vector<sim_touch> &v = s.w->touch[pos];
+  size_t c = s.cursor[pos];
+  if(c == v.size()){return UINT32_MAX;}
+  if(v[c].start > s.now){return v[c].start;}
+  uint32_t second = v[c].start + ((s.now - v[c].start)/1000 + 1)*1000;
+  return second < v[c].end ? second : v[c].end;
+}
+
+static void servo(sim &s, const servo_model &m, int dist){
+  double ms = sim_travel(m, dist);
+  s.servo_ms += ms;
+  if(s.passing){s.wasted_ms += ms;}
+}
+
+static void set_push(sim &s, int pulse){
+  servo(s, s.m->push, pulse - s.push);
+  s.push = pulse;
+  s.now += s.p->settle;
+}
+
+static void rotate_to_switch(sim &s, int pos){
+  if(pos != s.rot){
+    servo(s, s.m->rot, board_switch_pos[pos] - board_switch_pos[s.rot]);
+    s.now += s.p->settle + abs(s.rot - pos)*s.p->slot;
+    s.rotations++;
+  }
+  s.rot = pos;
+}
+
+static void move_lid(sim &s, bool open){
+  if(s.lid != open){
+    servo(s, s.m->lid, deckel_auf - deckel_min);
+    s.now += s.p->settle + s.p->lid;
+  }
+  s.lid = open;
+}
+
+static void retreat(sim &s){
+  set_push(s, arm_move_push_min);
+  s.now += s.p->retreat;
+}
+
+// the switch turns off once the push servo passes the contact
+static void push_switch(sim &s){
+  int pos = s.rot;
+  if(touch_status(s, pos)){return;}
+  uint32_t off = s.now + (s.push < s.m->contact ? (uint32_t)ceil(sim_travel(s.m->push, s.m->contact - s.push)) : 0);
+  set_push(s, s.p->arm_pressed);
+  do{
+    if(touch_status(s, pos)){break;}
+    s.now += s.p->push_poll;
+  }while(s.now < off);
+  if(s.now >= off && ((s.switches>>(SWITCH_COUNT-1-pos)) & 1)){
+    s.switches &= ~(1<<(SWITCH_COUNT-1-pos));
+    s.latency.push_back(off - s.since[pos]);
+  }
+  set_push(s, s.p->arm_waiting);
+  s.now += s.p->release;
+}
+
+static int compare(const void *a, const void *b){
+  uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+  return x < y ? -1 : x > y;
+}
+
+sim_result sim_run(const sim_workload &w, const motion_profile &p, const box_model &m, bool predictive){
+  sim s;
+  s.w = &w;
+  s.p = &p;
+  s.m = &m;
+  s.now = 0;
+  s.rot = 0;
+  s.lid = false;
+  s.push = arm_move_push_min;
+  s.passing = false;
+  s.switches = 0;
+  s.servo_ms = 0;
+  s.wasted_ms = 0;
+  s.rotations = 0;
+  memset(s.since, 0, sizeof(s.since));
+  memset(s.cursor, 0, sizeof(s.cursor));
+
+  flip_model model;
+  predict_init(model);
+  switchmap_t last_switches = 0;
+  size_t next = 0;
+  uint32_t limit = (w.flips.empty() ? 0 : w.flips.back().time) + 600000;
+
+  while((next < w.flips.size() || s.switches) && s.now < limit){
+    while(next < w.flips.size() && w.flips[next].time <= s.now){
+      s.switches |= 1<<(SWITCH_COUNT-1-w.flips[next].pos);
+      s.since[w.flips[next].pos] = w.flips[next].time;
+      next++;
+    }
+    uint16_t touch[SWITCH_COUNT];
+    bool pass = false, hand = false;
+    for(int i=0; i<SWITCH_COUNT; i++){
+      touch[i] = touch_status(s, i);
+      if(touch[i]){
+        if(w.touch[i][s.cursor[i]].pass){pass = true;}
+        else{hand = true;}
+      }
+    }
+    s.passing = pass && !hand && !s.switches;
+
+    base_step step = base_decide(s.switches, touch, s.rot, p);
+    if(predictive){
+      predict_update(model, last_switches, s.switches, s.now);
+      step = predict_step(model, step, s.rot, s.now);
+    }
+    last_switches = s.switches;
+
+    //nothing moves until the next flip, touch change or end of HOLD:
+    //skip the iterations in between
+    bool spin = step.action == BASE_WAIT || step.action == BASE_HOLD ||
+                (step.action == BASE_FOLLOW && step.target == s.rot);
+    bool rest = s.push == arm_move_push_min && !s.lid;
+    if(spin || ((step.action == BASE_IDLE || step.action == BASE_DONE) && rest)){
+      uint32_t period = spin ? sim_loop : p.settle + p.retreat;
+      uint32_t event = next < w.flips.size() ? w.flips[next].time : UINT32_MAX;
+      for(int i=0; i<SWITCH_COUNT; i++){
+        uint32_t t = touch_next(s, i);
+        if(t < event){event = t;}
+      }
+      if(model.flips >= predict_min_flips && model.interval < predict_hold_max){
+        uint32_t hold = model.last_flip + model.interval*3/2;
+        if(hold > s.now && hold < event){event = hold;}
+      }
+      if(event > limit){event = limit;}
+      s.now += event > s.now ? (event - s.now + period - 1)/period*period : period;
+      continue;
+    }
+
+    switch(step.action)
+    {
+      case BASE_PREPARE:
+        rotate_to_switch(s, step.target);
+        move_lid(s, true);
+        set_push(s, arm_move_push_max);
+        break;
+      case BASE_FOLLOW:
+        rotate_to_switch(s, step.target);
+        break;
+      case BASE_IDLE:
+      case BASE_DONE:
+        retreat(s);
+        move_lid(s, false);
+        break;
+      case BASE_RESET:
+        rotate_to_switch(s, step.target);
+        move_lid(s, true);
+        push_switch(s);
+        break;
+      case BASE_PARK:
+        retreat(s);
+        move_lid(s, false);
+        rotate_to_switch(s, step.target);
+        break;
+    }
+  }
+
+  for(int i=0; i<SWITCH_COUNT; i++){
+    if((s.switches>>(SWITCH_COUNT-1-i)) & 1){s.latency.push_back(s.now - s.since[i]);}
+  }
+  sim_result r;
+  memset(&r, 0, sizeof(r));
+  r.servo_ms = s.servo_ms;
+  r.wasted_ms = s.wasted_ms;
+  r.rotations = s.rotations;
+  if(s.latency.empty()){return r;}
+  qsort(s.latency.data(), s.latency.size(), sizeof(uint32_t), compare);
+  double sum = 0;
+  for(size_t i=0; i<s.latency.size(); i++){sum += s.latency[i];}
+  r.flips = s.latency.size();
+  r.latency = sum/s.latency.size();
+  r.p50 = s.latency[s.latency.size()/2];
+  r.p95 = s.latency[s.latency.size()*95/100];
+  r.servo = s.servo_ms/s.latency.size();
+  return r;
+}
@@ -0,0 +1,97 @@
+#ifndef BASE_SIM_H
+#define BASE_SIM_H
+
+// Host simulation of codeForBaseTask on a simulated clock.
+// Flips and pad touches of a workload go through base_decide() and
+// predict_step() like in the firmware, every servo move waits the delays of
+// a motion profile. Shared by tools/motion_tune.cpp and tools/predict_eval.cpp
+// so that both report the same latency for the same profile and workload.
+
+#include <stdint.h>
+#include <vector>
+
+#include "box_logic.h"
+
+#define sim_loop 10      // WAIT / HOLD iteration of codeForBaseTask [ms]
+
+//timing model --------------------------------------------------------
+
+struct servo_model {
+  double dead;      // [ms]
+  double per_us;    // [ms per us of pulse change]
+  int samples;
+};
+
+struct box_model {
+  servo_model rot, push, lid;
+  int contact;      // push pulse where the switch turns off [us]
+};
+
+// SG90 datasheet, 0.1 s per 60 degree, for servos without measurements
+extern const servo_model sim_sg90;
+
+// sim_sg90 on all servos, contact at 1830 us
+void sim_default_model(box_model &m);
+
+// ms until a servo is at rest after a pulse change of dist us
+double sim_travel(const servo_model &m, int dist);
+
+//workload ------------------------------------------------------------
+
+struct sim_flip {
+  uint32_t time;
+  uint8_t pos;
+};
+
+struct sim_touch {
+  uint32_t start, end;
+  bool pass;        // a hand passing by, no flip follows
+};
+
+struct sim_workload {
+  std::vector<sim_flip> flips;
+  std::vector<sim_touch> touch[SWITCH_COUNT];   // per pad, sorted, no overlaps
+};
+
+uint32_t sim_rng(uint32_t &state);
+uint32_t sim_range(uint32_t &state, uint32_t lo, uint32_t hi);
+
+// adds a touch of pad pos, merged into the last one if they overlap;
+// switches without a pad are never touched
+void sim_add_touch(sim_workload &w, int pos, uint32_t start, uint32_t end, bool pass = false);
+
+// play sessions of a few quick flips and long pauses, weights per switch
+// (NULL: 10, 5, 3, 1 for the first four, 1 for the rest). Most flips come
+// with the hand resting on the pad first, some approaches end without a flip.
+void sim_synthetic(sim_workload &w, int count, const int *weights, uint32_t &rng_state);
+
+// collects flips and touches from trace samples, with the pad rules of
+// touch_update(): values <= 5 are glitches, below th is touched
+struct sim_trace {
+  sim_workload *w;
+  uint16_t th;
+  switchmap_t last;
+  bool touched[SWITCH_COUNT];
+  uint32_t since[SWITCH_COUNT];
+};
+
+void sim_trace_init(sim_trace &t, sim_workload &w, uint16_t th);
+void sim_trace_sample(sim_trace &t, uint32_t time, switchmap_t switches, const uint16_t *touch);
+
+//simulation ----------------------------------------------------------
+
+struct sim_result {
+  uint32_t flips;     // latencies counted, flips never reset count with the time they stayed on
+  double latency;     // mean flip-to-reset [ms]
+  uint32_t p50, p95;
+  double servo;       // modelled servo travel per flip [ms]
+  double servo_ms;    // total [ms]
+  double wasted_ms;   // servo travel while only a passing hand was near [ms]
+  uint32_t rotations;
+};
+
+// predictive: the flip model of lib/BoxLogic/predict.h refines every step,
+// as in the firmware; false runs base_decide() alone
+sim_result sim_run(const sim_workload &w, const motion_profile &p, const box_model &m, bool predictive = true);
+
+#endif
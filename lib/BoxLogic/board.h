@@ -0,0 +1,79 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+// Board descriptor: one line per switch from left to right
+//   X(switch gpio, touch gpio or TOUCH_NONE, rotation servo pulse)
+// Everything sized per switch (config, touch, web boxes, traces) follows
+// from this list. Select a board with build_flags = -DBOARD_BOX8 etc.
+// Switches are active low with pull-up; at most 16 per board.
+
+#include <stdint.h>
+
+#define TOUCH_NONE 0xff
+
+#if defined(BOARD_BOX16)
+// not enough touch pads left for all switches; GPIO 34-39 are input only
+// without internal pull-up, fit external ones
+#define BOARD_SWITCHES(X) \
+  X(4, 32, 750)   X(5, 33, 863)   X(16, 15, 977)  X(17, 2, 1090) \
+  X(18, 0, 1203)  X(19, TOUCH_NONE, 1317) X(25, TOUCH_NONE, 1430) X(26, TOUCH_NONE, 1543) \
+  X(27, TOUCH_NONE, 1657) X(14, TOUCH_NONE, 1770) X(12, TOUCH_NONE, 1883) X(13, TOUCH_NONE, 1997) \
+  X(34, TOUCH_NONE, 2110) X(35, TOUCH_NONE, 2223) X(36, TOUCH_NONE, 2337) X(39, TOUCH_NONE, 2450)
+#elif defined(BOARD_BOX8)
+#define BOARD_SWITCHES(X) \
+  X(17, 13, 800)  X(16, 27, 1030) X(4, 14, 1260)  X(18, 12, 1490) \
+  X(19, 33, 1720) X(5, 32, 1950)  X(25, 15, 2180) X(26, 2, 2410)
+#else
+// UselessBox, B1 17, B2 16, B3 4, B4 18, touch T4 T7 T6 T5
+#define BOARD_SWITCHES(X) \
+  X(17, 13, 850) X(16, 27, 1300) X(4, 14, 1850) X(18, 12, 2400)
+#endif
+
+#define BOARD_COUNT_(pin, touch, pos) +1
+#define BOARD_PIN_(pin, touch, pos) pin,
+#define BOARD_TOUCH_(pin, touch, pos) touch,
+#define BOARD_POS_(pin, touch, pos) pos,
+#define BOARD_MASK_(pin, touch, pos) | (1ULL<<(pin))
+
+#define SWITCH_COUNT (0 BOARD_SWITCHES(BOARD_COUNT_))
+
+// switch i is bit (SWITCH_COUNT-1-i) of a switchmap
+typedef uint16_t switchmap_t;
+
+inline bool switch_on(switchmap_t switches, int pos){
+  return (switches>>(SWITCH_COUNT-1-pos)) & 1;
+}
+
+constexpr uint8_t board_switch_pins[] = {BOARD_SWITCHES(BOARD_PIN_)};
+constexpr uint8_t board_touch_pins[] = {BOARD_SWITCHES(BOARD_TOUCH_)};
+constexpr uint16_t board_switch_pos[] = {BOARD_SWITCHES(BOARD_POS_)};
+
+// GPIO input register bits of all switches (bit n = gpio n)
+constexpr uint64_t board_switch_mask = 0 BOARD_SWITCHES(BOARD_MASK_);
+
+static_assert(SWITCH_COUNT >= 4, "the first four switches select the boot options");
+static_assert(SWITCH_COUNT <= 16, "switchmap_t holds 16 switches");
+static_assert(board_touch_pins[0] != TOUCH_NONE && board_touch_pins[1] != TOUCH_NONE &&
+              board_touch_pins[2] != TOUCH_NONE && board_touch_pins[3] != TOUCH_NONE,
+              "move mode and the restart gesture use the first four pads");
+
+// Unrolled at compile time: moves the bit of every switch gpio to its
+// switchmap position. in holds GPIO_IN_REG (gpio 0-31) and GPIO_IN1_REG
+// (gpio 32-39) in the upper word, a set bit means pressed (inverted input).
+template<int I> inline switchmap_t board_gather(uint64_t in){
+  return (switchmap_t)(((in >> board_switch_pins[I]) & 1) << (SWITCH_COUNT-1-I)) | board_gather<I+1>(in);
+}
+template<> inline switchmap_t board_gather<SWITCH_COUNT>(uint64_t){
+  return 0;
+}
+
+inline switchmap_t board_switchmap(uint64_t in){
+  return board_gather<0>(~in & board_switch_mask);
+}
+
+// boot options and mode select use the first four switches like the 4 switch box
+inline uint8_t board_boot_bits(switchmap_t switches){
+  return switches >> (SWITCH_COUNT-4);
+}
+
+#endif
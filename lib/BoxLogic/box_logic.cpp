@@ -0,0 +1,63 @@
+#include "box_logic.h"
+
+#include <stdlib.h>
+
+uint16_t touch_update(touch_pad &pad, uint16_t status, int val, uint16_t th, unsigned long now){
+  if(val <= 5){
+    return status;
+  }
+  if(val < th){
+    if(pad.starttime == 0){
+      pad.starttime = now;
+    }
+    return 1+(uint16_t)((now - pad.starttime)/1000);
+  }
+  pad.starttime = 0;
+  return 0;
+}
+
+base_step base_decide(switchmap_t switches, const uint16_t *touch, int rot_pos, const motion_profile &profile){
+  base_step step = {BASE_WAIT, 0};
+  if(switches == 0){
+    int pos = -1;
+    for(int i=0; i<SWITCH_COUNT; i++){
+      if(touch[i]){
+        if(pos == -1){
+          pos = i;
+        }
+        else{
+          pos = -1;
+          break;
+        }
+      }
+    }
+    if(pos != -1){
+      step.target = pos;
+      //status is 1 + seconds touched
+      if(touch[pos] > profile.prepare_after){step.action = BASE_PREPARE;}
+      else if(touch[pos] > profile.follow_after){step.action = BASE_FOLLOW;}
+    }
+    else{
+      step.action = BASE_IDLE;
+    }
+  }
+  else{
+    //nearest switch that is on and not guarded by a touch
+    uint8_t next_target = SWITCH_COUNT+1;
+    int next_dist = SWITCH_COUNT+1;
+    for(int i=0; i<SWITCH_COUNT; i++){
+      if(!touch[i] && switch_on(switches, i) && abs(rot_pos-i) < next_dist){
+        next_target = i;
+        next_dist = abs(rot_pos-i);
+      }
+    }
+    if(next_target < SWITCH_COUNT+1){
+      step.action = BASE_RESET;
+      step.target = next_target;
+    }
+    else{
+      step.action = BASE_DONE;
+    }
+  }
+  return step;
+}
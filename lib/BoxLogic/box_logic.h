@@ -0,0 +1,45 @@
+#ifndef BOX_LOGIC_H
+#define BOX_LOGIC_H
+
+// Touch and base decision logic without any hardware access.
+// Used by the firmware tasks and by the host tools in tools/.
+
+#include <stdint.h>
+
+#include "board.h"
+#include "motion.h"
+
+//touch ---------------------------------------------------------------
+
+struct touch_pad {
+  unsigned long starttime;
+};
+
+// Feeds one touchRead() value into the pad filter.
+// Returns the new touch status (0 = free, n = touched for n-1 seconds).
+// Values <= 5 are read glitches and keep the previous status.
+uint16_t touch_update(touch_pad &pad, uint16_t status, int val, uint16_t th, unsigned long now);
+
+//base ----------------------------------------------------------------
+
+enum base_action {
+  BASE_WAIT,     // single pad touched shortly, keep everything as it is
+  BASE_FOLLOW,   // single pad touched >= follow_after, rotate to it
+  BASE_PREPARE,  // single pad touched >= prepare_after, rotate, open lid, raise arm
+  BASE_IDLE,     // all switches off, nobody near: sleep, retreat, close lid
+  BASE_RESET,    // push switch target back
+  BASE_DONE      // switches on but all guarded: retreat, close lid, sleep
+};
+
+struct base_step {
+  uint8_t action;
+  uint8_t target;
+};
+
+// One pass of codeForBaseTask.
+// switches: bitmap from get_switchmap(), switch i is bit (SWITCH_COUNT-1-i)
+// touch: touch status per pad, rot_pos: current_pos[0]
+// profile: dwell times, tools/motion_tune.cpp passes candidates
+base_step base_decide(switchmap_t switches, const uint16_t *touch, int rot_pos, const motion_profile &profile = motion);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+// Servo timing and touch dwell parameters of the box.
+// The values come from a profile header generated by tools/motion_tune.cpp,
+// motion_profile.h by default. A hardware revision can bring its own with
+// build_flags = -DMOTION_PROFILE='"motion_box8.h"'
+
+#include <stdint.h>
+
+// servo pulse limits of src/main.cpp [us], set_* refuses anything outside
+#define arm_move_push_min 1100
+#define arm_move_push_max 1750
+#define arm_move_pressed_max 1900   // push while pressing a switch
+#define arm_move_rot_min 750
+#define arm_move_rot_max 2450
+#define deckel_min 1060
+#define deckel_auf 1600
+#define deckel_max 2100
+
+struct motion_profile {
+  uint16_t settle;         // after every servo write [ms]
+  uint16_t slot;           // per switch slot in rotate_to_switch [ms]
+  uint16_t lid;            // extra wait in open_lid and close_lid [ms]
+  uint16_t retreat;        // extra wait in retreat [ms]
+  uint16_t push_poll;      // is_pressed poll in push_switch [ms]
+  uint16_t release;        // after pulling back from a pushed switch [ms]
+  uint16_t arm_waiting;    // push pulse in front of the switch [us]
+  uint16_t arm_pressed;    // push pulse that turns the switch off [us]
+  uint16_t follow_after;   // pad touched this many seconds: arm follows
+  uint16_t prepare_after;  // pad touched this many seconds: lid opens, arm rises
+};
+
+#ifdef MOTION_PROFILE
+#include MOTION_PROFILE
+#else
+#include "motion_profile.h"
+#endif
+
+static_assert(motion.arm_waiting >= arm_move_push_min && motion.arm_waiting <= arm_move_push_max,
+              "arm_waiting outside arm_move_push_min..arm_move_push_max");
+static_assert(motion.arm_pressed > arm_move_push_max && motion.arm_pressed <= arm_move_pressed_max,
+              "arm_pressed outside arm_move_push_max..arm_move_pressed_max");
+
+#endif
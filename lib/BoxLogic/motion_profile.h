@@ -0,0 +1,13 @@
+// Generated by tools/motion_tune.cpp, do not edit.
+//   motion_tune --current
+//
+// 4 switches, 3000 flips from synthetic workload
+// model, contact at 1830 us:
+//   rot   20.0 ms + 0.1500 ms/us, 0 measurements
+//   push  20.0 ms + 0.1500 ms/us, 0 measurements
+//   lid   20.0 ms + 0.1500 ms/us, 0 measurements
+// margins: 20% on travel, 40 us on pulses, prepare after >= 1 s
+// before   mean   685.3 ms  p50   832 ms  p95   978 ms  servo  563.7 ms per flip
+// after    mean   685.3 ms  p50   832 ms  p95   978 ms  servo  563.7 ms per flip
+
+constexpr motion_profile motion = {100, 150, 100, 200, 100, 100, 1700, 1900, 1, 2};
@@ -0,0 +1,87 @@
+#include "predict.h"
+
+#include <string.h>
+
+void predict_init(flip_model &model){
+  memset(&model, 0, sizeof(model));
+  model.interval = predict_interval_cap;
+}
+
+void predict_flip(flip_model &model, uint8_t pos, uint32_t now){
+  for(int i=0; i<SWITCH_COUNT; i++){
+    model.weight[i] -= model.weight[i]/8;
+  }
+  model.weight[pos] += 256;
+
+  //longer pauses end a play session and say nothing about the pace
+  uint32_t dt = now - model.last_flip;
+  if(model.flips && dt < predict_interval_cap){
+    model.interval = (model.interval*3 + dt)/4;
+  }
+  if(model.flips < 0xffff){model.flips++;}
+  model.last_flip = now;
+}
+
+void predict_update(flip_model &model, switchmap_t last, switchmap_t switches, uint32_t now){
+  switchmap_t on = switches & ~last;
+  for(int i=0; i<SWITCH_COUNT; i++){
+    if((on>>(SWITCH_COUNT-1-i)) & 1){
+      predict_flip(model, i, now);
+    }
+  }
+}
+
+uint32_t predict_cost(const flip_model &model, int pos){
+  uint32_t cost = 0;
+  for(int i=0; i<SWITCH_COUNT; i++){
+    cost += (uint32_t)model.weight[i] * (pos > i ? pos-i : i-pos);
+  }
+  return cost;
+}
+
+uint8_t predict_park(const flip_model &model, int rot_pos){
+  uint8_t best = rot_pos;
+  uint32_t best_cost = predict_cost(model, rot_pos);
+  for(int i=0; i<SWITCH_COUNT; i++){
+    uint32_t cost = predict_cost(model, i);
+    int dist = i > rot_pos ? i-rot_pos : rot_pos-i;
+    int best_dist = best > rot_pos ? best-rot_pos : rot_pos-best;
+    if(cost < best_cost || (cost == best_cost && dist < best_dist)){
+      best = i;
+      best_cost = cost;
+    }
+  }
+  return best;
+}
+
+base_step predict_step(const flip_model &model, base_step step, int rot_pos, uint32_t now){
+  if(model.flips < predict_min_flips || (step.action != BASE_WAIT && step.action != BASE_IDLE)){
+    return step;
+  }
+
+  uint32_t total = 0;
+  for(int i=0; i<SWITCH_COUNT; i++){
+    total += model.weight[i];
+  }
+
+  if(step.action == BASE_WAIT){
+    //a touch on a rarely flipped pad is mostly a hand passing by
+    if(step.target != rot_pos && (uint32_t)model.weight[step.target]*SWITCH_COUNT*100 >= total*predict_follow_min){
+      step.action = BASE_FOLLOW;
+    }
+    return step;
+  }
+
+  uint32_t since = now - model.last_flip;
+  if(model.interval < predict_hold_max && since < model.interval*3/2){
+    step.action = BASE_HOLD;
+    return step;
+  }
+
+  uint8_t park = predict_park(model, rot_pos);
+  if(park != rot_pos && (predict_cost(model, rot_pos) - predict_cost(model, park))*predict_min_gain >= total){
+    step.action = BASE_PARK;
+    step.target = park;
+  }
+  return step;
+}
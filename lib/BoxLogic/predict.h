@@ -0,0 +1,50 @@
+#ifndef PREDICT_H
+#define PREDICT_H
+
+// Online flip statistics used to pre-position the arm while idle.
+// Per-switch flip weights decay by 1/8 per flip, the inter-flip time within
+// a play session is an EWMA.
+
+#include <stdint.h>
+
+#include "box_logic.h"
+
+#define predict_min_flips 4      // no parking before the model has seen this many flips
+#define predict_min_gain 2       // park only if it saves >= 1/predict_min_gain slot on average
+#define predict_hold_max 4000    // keep the lid open only if flips come faster than this [ms]
+#define predict_interval_cap 10000 // flips further apart start a new session [ms]
+#define predict_follow_min 50    // follow a short touch only to pads with >= this % of the mean flip weight
+
+// additional actions on top of base_action
+#define BASE_PARK 6   // rotate to target while idle, then sleep again
+#define BASE_HOLD 7   // flip expected soon: keep lid open and servos attached
+
+struct flip_model {
+  uint16_t weight[SWITCH_COUNT];
+  uint16_t flips;
+  uint32_t last_flip;
+  uint32_t interval;
+};
+
+void predict_init(flip_model &model);
+
+// switch pos was turned on by the user
+void predict_flip(flip_model &model, uint8_t pos, uint32_t now);
+
+// calls predict_flip for every bit that is set in switches but not in last
+void predict_update(flip_model &model, switchmap_t last, switchmap_t switches, uint32_t now);
+
+// expected rotation distance to the next flip from pos, in slots * total weight
+uint32_t predict_cost(const flip_model &model, int pos);
+
+// position with the lowest expected cost, ties resolved towards rot_pos
+uint8_t predict_park(const flip_model &model, int rot_pos);
+
+// Refines an idle step from base_decide():
+//  BASE_WAIT (pad touched < 1s) -> BASE_FOLLOW that pad (approach) if the
+//               model has seen enough flips and the pad is flipped often enough
+//  BASE_IDLE -> BASE_HOLD shortly after a flip if flips come fast,
+//               BASE_PARK if the expected saving is worth the move
+base_step predict_step(const flip_model &model, base_step step, int rot_pos, uint32_t now);
+
+#endif
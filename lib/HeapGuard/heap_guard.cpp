@@ -0,0 +1,44 @@
+#include "heap_guard.h"
+
+static volatile bool sealed = false;
+static volatile int paused = 0;
+static volatile unsigned long count = 0;
+static volatile unsigned long violations = 0;
+static heap_watch watch = 0;
+static heap_panic panic = 0;
+
+void heap_guard_seal(heap_watch watched, heap_panic handler){
+  watch = watched;
+  panic = handler;
+  count = 0;
+  violations = 0;
+  sealed = true;
+}
+
+bool heap_guard_sealed(){
+  return sealed;
+}
+
+void heap_guard_pause(){
+  paused++;
+}
+
+void heap_guard_resume(){
+  paused--;
+}
+
+void heap_guard_alloc(size_t size){
+  if(!sealed){return;}
+  count++;
+  if(paused > 0 || (watch && !watch())){return;}
+  violations++;
+  if(panic){panic(size);}
+}
+
+unsigned long heap_guard_count(){
+  return count;
+}
+
+unsigned long heap_guard_violations(){
+  return violations;
+}
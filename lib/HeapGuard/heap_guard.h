@@ -0,0 +1,28 @@
+#ifndef HEAP_GUARD_H
+#define HEAP_GUARD_H
+
+// Allocation check for the STATIC_ALLOC build.
+// The allocator hooks (malloc wrappers on the box, malloc overrides in
+// test/test_heap_soak) call heap_guard_alloc() for every allocation.
+// After heap_guard_seal() every allocation is counted, allocations from a
+// watched context call the panic handler.
+
+#include <stddef.h>
+
+typedef bool (*heap_watch)();             // true if the caller must not allocate
+typedef void (*heap_panic)(size_t size);
+
+void heap_guard_seal(heap_watch watched, heap_panic panic);
+bool heap_guard_sealed();
+
+// Allocations between pause and resume are counted but allowed,
+// for library calls that allocate internally (nvs writes).
+void heap_guard_pause();
+void heap_guard_resume();
+
+void heap_guard_alloc(size_t size);
+
+unsigned long heap_guard_count();        // allocations since the seal
+unsigned long heap_guard_violations();   // of those from watched contexts
+
+#endif
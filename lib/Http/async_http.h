@@ -0,0 +1,121 @@
+#ifndef ASYNC_HTTP_H
+#define ASYNC_HTTP_H
+
+// Binds http_route tables to ESPAsyncWebServer, assets come from SPIFFS.
+// With STATIC_ALLOC streamed responses are rendered into http_slots
+// instead of a growing AsyncResponseStream.
+
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+
+#include "http.h"
+#include "http_slots.h"
+
+class async_request : public http_request {
+public:
+  async_request(AsyncWebServerRequest *request) : request(request) {}
+
+  const char *path(){return request->url().c_str();}
+
+  bool param(const char *name, char *out, size_t cap){
+    if(!request->hasParam(name)){return false;}
+    strlcpy(out, request->getParam(name)->value().c_str(), cap);
+    return true;
+  }
+
+private:
+  AsyncWebServerRequest *request;
+};
+
+class async_response : public http_response {
+public:
+#ifdef STATIC_ALLOC
+  async_response(AsyncWebServerRequest *request) : request(request), type(NULL), slot(NULL) {}
+
+  // sends a streamed response from its slot once the handler returned
+  ~async_response(){
+    if(type == NULL){return;}
+    if(slot == NULL){
+      request->send(503, "text/plain", "Busy");
+      return;
+    }
+    if(slot->overflow){
+      http_slot_give(slot);
+      request->send(500, "text/plain", "Response too large");
+      return;
+    }
+    http_slot *s = slot;
+    request->onDisconnect([s](){http_slot_give(s);});
+    request->send(request->beginResponse(type, s->len, [s](uint8_t *buffer, size_t max_len, size_t index) -> size_t {
+      return http_slot_read(s, (char*)buffer, max_len, index);
+    }));
+  }
+#else
+  async_response(AsyncWebServerRequest *request) : request(request), stream(NULL) {}
+
+  // sends a streamed response once the handler returned
+  ~async_response(){
+    if(stream){request->send(stream);}
+  }
+#endif
+
+  void send(int status, const char *type, const char *body){
+    request->send(status, type, body);
+  }
+
+  void send_file(const char *path, const char *type, const char *encoding, const char *cache){
+    AsyncWebServerResponse* response = request->beginResponse(SPIFFS, path, type);
+    if(response == NULL){
+      request->send(404, "text/plain", "Not found");
+      return;
+    }
+    if(encoding){
+      response->addHeader("Content-Encoding", encoding);
+    }
+    if(cache){
+      response->addHeader("Cache-Control", cache);
+    }
+    request->send(response);
+  }
+
+#ifdef STATIC_ALLOC
+  void begin(const char *type){
+    this->type = type;
+    slot = http_slot_take();
+  }
+
+  void write(const char *data, size_t len){
+    if(slot){http_slot_write(slot, data, len);}
+  }
+
+private:
+  AsyncWebServerRequest *request;
+  const char *type;
+  http_slot *slot;
+#else
+  void begin(const char *type){
+    stream = request->beginResponseStream(type);
+  }
+
+  void write(const char *data, size_t len){
+    stream->write((const uint8_t*)data, len);
+  }
+
+private:
+  AsyncWebServerRequest *request;
+  AsyncResponseStream *stream;
+#endif
+};
+
+inline void async_http_register(AsyncWebServer &server, const http_route *routes, size_t count){
+  for(size_t i=0; i<count; i++){
+    const http_route *route = &routes[i];
+    server.on(route->path, HTTP_GET, [route](AsyncWebServerRequest *request){
+      async_request req(request);
+      async_response res(request);
+      route->handler(req, res, *route);
+    });
+  }
+}
+
+#endif
@@ -0,0 +1,164 @@
+#include "box_routes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const box_app *app = NULL;
+// requests are handled one at a time by the server task
+static box_state state;
+
+void box_routes_init(const box_app *box){
+  app = box;
+}
+
+// status boxes ----------------------------------------------------
+
+static int key_index(const char *key, int prefix){
+  int pos = atoi(key+prefix);
+  return pos >= 0 && pos < SWITCH_COUNT ? pos : 0;
+}
+
+static void info_processor(const char *key, http_response &res){
+  if(strcmp(key, "uptime") == 0){
+    unsigned long sec = state.uptime / 1000;
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%02lu:%02lu:%02lu", sec / 3600, sec / 60 % 60, sec % 60);
+    res.print(buffer);
+  }
+  else if(strcmp(key, "mode") == 0){res.print(state.mode);}
+  else if(strcmp(key, "conf") == 0){res.print(state.battery ? "Battery" : "Wired");}
+  else if(strcmp(key, "serial") == 0){res.print(state.serial ? "true" : "false");}
+  else if(strcmp(key, "reset") == 0){res.print(state.reset ? "true" : "false");}
+  else{res.print("N/A");}
+}
+
+static void switch_processor(const char *key, http_response &res){
+  if(strcmp(key, "rows") == 0){
+    for(int i=0; i<SWITCH_COUNT; i++){
+      res.print("<tr><td>"); res.print(i+1);
+      res.print("</td><td class=\"bool_switch\">");
+      res.print(switch_on(state.switches, i) ? "true" : "false");
+      res.print("</td><td class=\"touch_switch\">"); res.print(state.touch_status[i]);
+      res.print("s</td><td class=\"blue\">"); res.print(state.touch_value[i]);
+      res.print("</td></tr>");
+    }
+  }
+  else if(strncmp(key, "switch", 6) == 0){
+    res.print(switch_on(state.switches, key_index(key, 6)) ? "true" : "false");
+  }
+  else if(strncmp(key, "touch", 5) == 0){
+    res.print(state.touch_status[key_index(key, 5)]);
+    res.print("s");
+  }
+  else if(strncmp(key, "tval", 4) == 0){
+    res.print(state.touch_value[key_index(key, 4)]);
+  }
+  else{
+    res.print("N/A");
+  }
+}
+
+static void config_processor(const char *key, http_response &res){
+  if(strcmp(key, "rows") == 0){
+    //one row per switch of the board
+    for(int i=0; i<SWITCH_COUNT; i++){
+      res.print("<tr><td>"); res.print(i+1);
+      res.print("</td><td class=\"green\">"); res.print(state.config[i][0]);
+      res.print("</td><td class=\"red\">"); res.print(state.config[i][1]);
+      res.print("</td><td class=\"blue\">"); res.print(state.config[i][2]);
+      res.print("</td></tr>");
+    }
+  }
+  else if(strncmp(key, "cst", 3) == 0){
+    res.print(state.config[key_index(key, 3)][0]);
+  }
+  else if(strncmp(key, "csf", 3) == 0){
+    res.print(state.config[key_index(key, 3)][1]);
+  }
+  else if(strncmp(key, "csh", 3) == 0){
+    res.print(state.config[key_index(key, 3)][2]);
+  }
+  else{
+    res.print("N/A");
+  }
+}
+
+static void send_box(http_response &res, const http_route &route, uint8_t parts, http_processor processor){
+  size_t len = 0;
+  const char *html = app->box_template(route.file, &len);
+  app->snapshot(state, parts);
+  res.begin(route.type);
+  http_expand(res, html, len, processor);
+}
+
+static void info_box(http_request &req, http_response &res, const http_route &route){
+  (void)req;
+  send_box(res, route, BOX_INFO, info_processor);
+}
+
+static void switch_box(http_request &req, http_response &res, const http_route &route){
+  (void)req;
+  send_box(res, route, BOX_SWITCHES, switch_processor);
+}
+
+static void config_box(http_request &req, http_response &res, const http_route &route){
+  (void)req;
+  send_box(res, route, BOX_CONFIG, config_processor);
+}
+
+static void move_data(http_request &req, http_response &res, const http_route &route){
+  (void)route;
+  int coords[2] = {0,0};
+  char val[12];
+  if(req.param("x", val, sizeof(val))){
+    coords[0] = atoi(val);
+  }
+  if(req.param("y", val, sizeof(val))){
+    coords[1] = atoi(val);
+  }
+  app->move(coords[0], coords[1]);
+  res.send(200, "text/plain", "done");
+}
+
+#define cache_hour "max-age=3600, must-revalidate"
+#define cache_5min "max-age=300, must-revalidate"
+
+const http_route box_routes[] = {
+  // favicon
+  {"/favicon.ico", http_send_asset, "/favicon.ico", "image/vnd.microsoft.icon", NULL, cache_hour},
+
+  // js
+  {"/jQuery.js", http_send_asset, "/jQuery.js.gz", "text/javascript", "gzip", cache_hour},
+  {"/main.js", http_send_asset, "/main.js", "text/javascript", NULL, cache_5min},
+
+  // CSS
+  {"/main.css", http_send_asset, "/main.css", "text/css", NULL, cache_5min},
+  {"/color_scheme.css", http_send_asset, "/color_scheme.css", "text/css", NULL, cache_hour},
+  {"/fa-minimal.css", http_send_asset, "/fa-minimal.css", "text/css", NULL, cache_hour},
+
+  // Pages
+  {"/", http_send_asset, "/index.html", "text/html", NULL, NULL},
+  {"/index.html", http_send_asset, "/index.html", "text/html", NULL, NULL},
+  {"/sidenav.html", http_send_asset, "/sidenav.html", "text/html", NULL, NULL},
+  {"/config_page.html", http_send_asset, "/config_page.html", "text/html", NULL, NULL},
+  {"/move.html", http_send_asset, "/move.html", "text/html", NULL, NULL},
+
+  // POSTS
+  {"/move_data", move_data, NULL, "text/plain", NULL, NULL},
+
+  // Status Boxes
+  {"/info_box.html", info_box, "/info_box.html", "text/html", NULL, NULL},
+  {"/switch_box.html", switch_box, "/switch_box.html", "text/html", NULL, NULL},
+  {"/config_box.html", config_box, "/config_box.html", "text/html", NULL, NULL},
+
+  // Fonts
+  {"/webfonts/fa-regular-400.ttf", http_send_asset, "/fa-regular-400.ttf", "font/ttf", NULL, cache_hour},
+  {"/webfonts/fa-regular-400.woff", http_send_asset, "/fa-regular-400.woff", "font/woff", NULL, cache_hour},
+  {"/webfonts/fa-regular-400.woff2", http_send_asset, "/fa-regular-400.woff2", "font/woff2", NULL, cache_hour},
+  {"/webfonts/fa-solid-900.ttf", http_send_asset, "/fa-solid-900.ttf", "font/ttf", NULL, cache_hour},
+  {"/webfonts/fa-solid-900.woff", http_send_asset, "/fa-solid-900.woff", "font/woff", NULL, cache_hour},
+  {"/webfonts/fa-solid-900.woff2", http_send_asset, "/fa-solid-900.woff2", "font/woff2", NULL, cache_hour},
+};
+
+const size_t box_route_count = sizeof(box_routes)/sizeof(box_routes[0]);
@@ -0,0 +1,47 @@
+#ifndef BOX_ROUTES_H
+#define BOX_ROUTES_H
+
+// Web routes of the UselessBox: pages, static assets, status boxes and
+// /move_data. The box state is reached through box_app only, the status
+// boxes are rendered here from a box_state snapshot.
+
+#include <stdint.h>
+
+#include <board.h>
+
+#include "http.h"
+
+// parts of box_state a status box needs
+#define BOX_INFO 1
+#define BOX_SWITCHES 2
+#define BOX_CONFIG 4
+
+struct box_state {
+  // BOX_INFO
+  unsigned long uptime;                  // [ms]
+  const char *mode;                      // mode_name()
+  bool battery;                          // battery config set
+  bool serial;
+  bool reset;                            // restart gesture enabled
+  // BOX_SWITCHES
+  switchmap_t switches;                  // as get_switchmap()
+  uint16_t touch_status[SWITCH_COUNT];   // 0 free, n touched for n-1 s
+  uint16_t touch_value[SWITCH_COUNT];    // touchRead()
+  // BOX_CONFIG
+  uint16_t config[SWITCH_COUNT][3];      // touched, free, threshold
+};
+
+struct box_app {
+  // fills the parts of state, called once per status box request
+  void (*snapshot)(box_state &state, uint8_t parts);
+  // cached template text of a status box (/info_box.html ...)
+  const char *(*box_template)(const char *file, size_t *len);
+  void (*move)(int x, int y);
+};
+
+void box_routes_init(const box_app *app);
+
+extern const http_route box_routes[];
+extern const size_t box_route_count;
+
+#endif
@@ -0,0 +1,73 @@
+#include "http.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define http_key_max 32
+
+void http_response::print(const char *text){
+  write(text, strlen(text));
+}
+
+void http_response::print(long val){
+  char buffer[12];
+  int n = snprintf(buffer, sizeof(buffer), "%ld", val);
+  write(buffer, n);
+}
+
+void http_expand(http_response &res, const char *html, size_t len, http_processor processor){
+  const char placeholder = '~';
+  size_t start = 0;
+  size_t i = 0;
+  while(i < len){
+    if(html[i] != placeholder){
+      i++;
+      continue;
+    }
+    //plain text up to the placeholder in one piece
+    if(i > start){res.write(html+start, i-start);}
+    const char *end = (const char*)memchr(html+i+1, placeholder, len-i-1);
+    if(end == NULL){
+      start = i;
+      break;
+    }
+    size_t key_len = end - (html+i+1);
+    if(key_len == 0){
+      res.write(&placeholder, 1);
+    }
+    else{
+      char key[http_key_max+1];
+      if(key_len > http_key_max){key_len = http_key_max;}
+      memcpy(key, html+i+1, key_len);
+      key[key_len] = 0;
+      processor(key, res);
+    }
+    i = end - html + 1;
+    start = i;
+  }
+  if(start < len){res.write(html+start, len-start);}
+}
+
+const http_route *http_find(const http_route *routes, size_t count, const char *path){
+  for(size_t i=0; i<count; i++){
+    if(strcmp(routes[i].path, path) == 0){
+      return &routes[i];
+    }
+  }
+  return NULL;
+}
+
+static volatile bool assets_available = true;
+
+void http_assets_available(bool available){
+  assets_available = available;
+}
+
+void http_send_asset(http_request &req, http_response &res, const http_route &route){
+  (void)req;
+  if(!assets_available){
+    res.send(503, "text/plain", "Updating");
+    return;
+  }
+  res.send_file(route.file, route.type, route.encoding, route.cache);
+}
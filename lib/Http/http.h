@@ -0,0 +1,57 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+// Request/response interface for the web routes, independent of the server.
+// Bound to ESPAsyncWebServer by async_http.h and to POSIX sockets by
+// tools/http_host.cpp.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class http_request {
+public:
+  virtual ~http_request(){}
+  virtual const char *path() = 0;
+  // query parameter, false if missing
+  virtual bool param(const char *name, char *out, size_t cap) = 0;
+};
+
+class http_response {
+public:
+  virtual ~http_response(){}
+  // complete response with a small body
+  virtual void send(int status, const char *type, const char *body) = 0;
+  // file from the asset store, cache NULL sends no Cache-Control
+  virtual void send_file(const char *path, const char *type, const char *encoding, const char *cache) = 0;
+  // streamed 200 response, followed by write() calls
+  virtual void begin(const char *type) = 0;
+  virtual void write(const char *data, size_t len) = 0;
+
+  void print(const char *text);
+  void print(long val);
+};
+
+// prints the value of a ~key~ placeholder
+typedef void (*http_processor)(const char *key, http_response &res);
+
+struct http_route {
+  const char *path;
+  void (*handler)(http_request &req, http_response &res, const http_route &route);
+  const char *file;       // asset or template served by the route
+  const char *type;
+  const char *encoding;   // "gzip" for precompressed assets
+  const char *cache;      // Cache-Control value, a literal so no header is built per request
+};
+
+// Streams html, replacing ~key~ by processor output and ~~ by ~
+void http_expand(http_response &res, const char *html, size_t len, http_processor processor);
+
+const http_route *http_find(const http_route *routes, size_t count, const char *path);
+
+// handler for plain asset routes, 503 while assets are unavailable
+void http_send_asset(http_request &req, http_response &res, const http_route &route);
+
+// false while the asset store is being replaced
+void http_assets_available(bool available);
+
+#endif
@@ -0,0 +1,38 @@
+#include "http_slots.h"
+
+#include <string.h>
+
+static http_slot slots[HTTP_SLOTS];
+
+http_slot *http_slot_take(){
+  for(int i=0; i<HTTP_SLOTS; i++){
+    if(!slots[i].used){
+      slots[i].used = true;
+      slots[i].len = 0;
+      slots[i].overflow = false;
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+void http_slot_give(http_slot *slot){
+  slot->used = false;
+}
+
+void http_slot_write(http_slot *slot, const char *data, size_t len){
+  if(slot->len + len > HTTP_SLOT_SIZE){
+    len = HTTP_SLOT_SIZE - slot->len;
+    slot->overflow = true;
+  }
+  memcpy(slot->data + slot->len, data, len);
+  slot->len += len;
+}
+
+size_t http_slot_read(const http_slot *slot, char *out, size_t cap, size_t index){
+  if(index >= slot->len){return 0;}
+  size_t len = slot->len - index;
+  if(len > cap){len = cap;}
+  memcpy(out, slot->data + index, len);
+  return len;
+}
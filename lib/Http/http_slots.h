@@ -0,0 +1,29 @@
+#ifndef HTTP_SLOTS_H
+#define HTTP_SLOTS_H
+
+// Fixed response buffers for the STATIC_ALLOC build.
+// A streamed response is rendered into a free slot and sent from there,
+// the slot is given back once the connection is closed. Slots are taken
+// and given by the server task only, there is no locking.
+
+#include <stddef.h>
+
+#define HTTP_SLOTS 4
+#define HTTP_SLOT_SIZE 4096
+
+struct http_slot {
+  char data[HTTP_SLOT_SIZE];
+  size_t len;
+  bool overflow;   // writes past HTTP_SLOT_SIZE were dropped
+  bool used;
+};
+
+// NULL if all slots are busy
+http_slot *http_slot_take();
+void http_slot_give(http_slot *slot);
+void http_slot_write(http_slot *slot, const char *data, size_t len);
+
+// copies the part of the slot starting at index, returns the bytes copied
+size_t http_slot_read(const http_slot *slot, char *out, size_t cap, size_t index);
+
+#endif
@@ -0,0 +1,181 @@
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_FORMAT_(name, level, format) format,
+#define LOG_LEVELS_(name, level, format) level,
+
+const char *const log_formats[log_count] = {LOG_MESSAGES(LOG_FORMAT_)};
+const uint8_t log_levels[log_count] = {LOG_MESSAGES(LOG_LEVELS_)};
+
+log_ring log_main;
+volatile uint8_t log_level = LOG_OFF;
+
+static uint32_t no_clock(){
+  return 0;
+}
+
+static uint32_t (*log_clock)() = no_clock;
+
+void log_init(uint32_t (*clock)()){
+  memset(&log_main, 0, sizeof(log_main));
+  for(uint32_t i=0; i<LOG_RING_SIZE; i++){
+    log_main.slots[i].seq = i;
+  }
+  log_clock = clock;
+}
+
+// bounded multi producer queue: a slot is free for position pos when its
+// seq equals pos, the producer that wins the head CAS owns it
+bool log_write(uint16_t id, uint8_t argc, const int32_t *args){
+  log_ring &ring = log_main;
+  uint32_t pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+  log_slot *slot;
+  for(;;){
+    slot = &ring.slots[pos & (LOG_RING_SIZE-1)];
+    int32_t diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if(diff == 0){
+      if(__atomic_compare_exchange_n(&ring.head, &pos, pos+1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+        break;
+      }
+    }
+    else if(diff < 0){
+      __atomic_fetch_add(&ring.dropped, 1, __ATOMIC_RELAXED);
+      return false;
+    }
+    else{
+      pos = __atomic_load_n(&ring.head, __ATOMIC_RELAXED);
+    }
+  }
+  slot->rec.time = log_clock();
+  slot->rec.id = id;
+  slot->rec.argc = argc;
+  for(int i=0; i<argc; i++){
+    slot->rec.args[i] = args[i];
+  }
+  __atomic_store_n(&slot->seq, pos+1, __ATOMIC_RELEASE);
+  return true;
+}
+
+bool log_read(log_ring &ring, log_record &rec){
+  log_slot *slot = &ring.slots[ring.tail & (LOG_RING_SIZE-1)];
+  if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != ring.tail+1){
+    return false;
+  }
+  rec = slot->rec;
+  __atomic_store_n(&slot->seq, ring.tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+  ring.tail++;
+  return true;
+}
+
+size_t log_format(const log_record &rec, char *out, size_t cap){
+  static const char level_names[] = "DIWE";
+  int n = snprintf(out, cap, "[%5lu.%06lu] ", (unsigned long)(rec.time / 1000000), (unsigned long)(rec.time % 1000000));
+  if(n < 0 || (size_t)n >= cap){return cap ? cap-1 : 0;}
+  int m;
+  if(rec.id < log_count){
+    long a[LOG_ARGS] = {0};
+    for(int i=0; i<rec.argc && i<LOG_ARGS; i++){
+      a[i] = rec.args[i];
+    }
+    m = snprintf(out+n, cap-n, "%c ", level_names[log_levels[rec.id]]);
+    if(m > 0 && (size_t)(n+m) < cap){
+      n += m;
+      m = snprintf(out+n, cap-n, log_formats[rec.id], a[0], a[1], a[2], a[3]);
+    }
+  }
+  else{
+    m = snprintf(out+n, cap-n, "? message %u", rec.id);
+  }
+  if(m < 0){return n;}
+  return (size_t)(n+m) < cap ? n+m : cap-1;
+}
+
+static void put_u32(uint8_t *out, uint32_t val){
+  out[0] = val;
+  out[1] = val >> 8;
+  out[2] = val >> 16;
+  out[3] = val >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *in){
+  return in[0] | in[1]<<8 | (uint32_t)in[2]<<16 | (uint32_t)in[3]<<24;
+}
+
+// crc16 ccitt, strong enough to resync on a noisy line
+static uint16_t checksum(const uint8_t *data, size_t len){
+  uint16_t crc = 0xffff;
+  for(size_t i=0; i<len; i++){
+    crc ^= data[i] << 8;
+    for(int b=0; b<8; b++){
+      crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+size_t log_frame(const log_record &rec, uint8_t *out){
+  size_t n = 0;
+  out[n++] = LOG_FRAME_SYNC;
+  out[n++] = rec.argc;
+  out[n++] = rec.id;
+  out[n++] = rec.id >> 8;
+  put_u32(out+n, rec.time);
+  n += 4;
+  for(int i=0; i<rec.argc; i++){
+    put_u32(out+n, rec.args[i]);
+    n += 4;
+  }
+  uint16_t crc = checksum(out+1, n-1);
+  out[n++] = crc;
+  out[n++] = crc >> 8;
+  return n;
+}
+
+void log_parser_init(log_parser &p){
+  p.len = 0;
+  p.skipped = 0;
+}
+
+// drops bytes up to the next sync byte after the first one
+static void resync(log_parser &p){
+  size_t i = 1;
+  while(i < p.len && p.buf[i] != LOG_FRAME_SYNC){
+    i++;
+  }
+  p.skipped += i;
+  memmove(p.buf, p.buf+i, p.len-i);
+  p.len -= i;
+}
+
+bool log_parse(log_parser &p, uint8_t byte, log_record &rec){
+  if(p.len == 0 && byte != LOG_FRAME_SYNC){
+    p.skipped++;
+    return false;
+  }
+  p.buf[p.len++] = byte;
+  for(;;){
+    if(p.len < 2){return false;}
+    if(p.buf[1] > LOG_ARGS){
+      resync(p);
+      continue;
+    }
+    size_t size = 10 + 4*p.buf[1];
+    if(p.len < size){return false;}
+    if(checksum(p.buf+1, size-3) != (p.buf[size-2] | p.buf[size-1]<<8)){
+      resync(p);
+      continue;
+    }
+    rec.argc = p.buf[1];
+    rec.id = p.buf[2] | p.buf[3]<<8;
+    rec.time = get_u32(p.buf+4);
+    for(int i=0; i<rec.argc; i++){
+      rec.args[i] = get_u32(p.buf+8+4*i);
+    }
+    //bytes behind the frame are left from a resync
+    memmove(p.buf, p.buf+size, p.len-size);
+    p.len -= size;
+    return true;
+  }
+}
@@ -0,0 +1,118 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Deferred binary logging.
+// LOG(name, args...) copies message index, time and up to LOG_ARGS int32
+// values into a lock-free ring and returns, it never blocks: a full ring
+// drops the record and counts it. A low priority task drains the ring and
+// formats or frames the records for Serial.
+//
+// Frame (log_frame), little endian:
+//   0xa5, argc u8, id u16, time u32 [us], args i32 * argc, crc16 over all but 0xa5
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+#define LOG_OFF 4
+
+#include "log_messages.h"
+
+// calls below this level are not compiled in
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_DEBUG
+#endif
+
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 256   // records, power of two
+#endif
+
+#define LOG_VERSION 1
+#define LOG_ARGS 4
+#define LOG_FRAME_SYNC 0xa5
+#define LOG_FRAME_MAX (10 + 4*LOG_ARGS)
+
+#define LOG_ID_(name, level, format) log_##name,
+#define LOG_LEVEL_(name, level, format) log_level_##name = level,
+enum log_id { LOG_MESSAGES(LOG_ID_) log_count };
+enum log_message_level { LOG_MESSAGES(LOG_LEVEL_) };
+
+struct log_record {
+  uint32_t time;
+  uint16_t id;
+  uint8_t argc;
+  int32_t args[LOG_ARGS];
+};
+
+struct log_slot {
+  uint32_t seq;       // position + 1 once the record is complete
+  log_record rec;
+};
+
+struct log_ring {
+  log_slot slots[LOG_RING_SIZE];
+  uint32_t head;      // next position to reserve, producers
+  uint32_t tail;      // next position to read, drain task only
+  uint32_t dropped;
+};
+
+extern log_ring log_main;
+extern volatile uint8_t log_level;     // runtime threshold, LOG_OFF disables
+extern const char *const log_formats[log_count];
+extern const uint8_t log_levels[log_count];
+
+void log_init(uint32_t (*clock)());
+
+// any task or core, false if the ring was full
+bool log_write(uint16_t id, uint8_t argc, const int32_t *args);
+
+inline bool log_put(uint16_t id){
+  return log_write(id, 0, NULL);
+}
+inline bool log_put(uint16_t id, int32_t a){
+  int32_t args[1] = {a};
+  return log_write(id, 1, args);
+}
+inline bool log_put(uint16_t id, int32_t a, int32_t b){
+  int32_t args[2] = {a, b};
+  return log_write(id, 2, args);
+}
+inline bool log_put(uint16_t id, int32_t a, int32_t b, int32_t c){
+  int32_t args[3] = {a, b, c};
+  return log_write(id, 3, args);
+}
+inline bool log_put(uint16_t id, int32_t a, int32_t b, int32_t c, int32_t d){
+  int32_t args[4] = {a, b, c, d};
+  return log_write(id, 4, args);
+}
+
+#define LOG(name, ...) do{ \
+    if(log_level_##name >= LOG_MIN_LEVEL && log_level_##name >= log_level){ \
+      log_put(log_##name, ##__VA_ARGS__); \
+    } \
+  }while(0)
+
+// single consumer, false if the ring is empty
+bool log_read(log_ring &ring, log_record &rec);
+
+// "[   12.345678] I message", returns the length
+size_t log_format(const log_record &rec, char *out, size_t cap);
+
+// returns the frame length
+size_t log_frame(const log_record &rec, uint8_t *out);
+
+// Frame decoder for a raw byte stream, resyncs after garbage
+struct log_parser {
+  uint8_t buf[LOG_FRAME_MAX];
+  size_t len;
+  unsigned long skipped;    // bytes outside of valid frames
+};
+
+void log_parser_init(log_parser &p);
+// feeds one byte, true if rec holds a complete frame
+bool log_parse(log_parser &p, uint8_t byte, log_record &rec);
+
+#endif
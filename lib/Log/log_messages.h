@@ -0,0 +1,20 @@
+#ifndef LOG_MESSAGES_H
+#define LOG_MESSAGES_H
+
+// All log messages: X(name, level, format).
+// Records only carry the message index and up to LOG_ARGS int32 values,
+// formats use %ld. Append new messages at the end, tools/log_decode.cpp
+// decodes by index.
+
+#define LOG_MESSAGES(X) \
+  X(start,        LOG_INFO,  "log v%ld, %ld messages") \
+  X(dropped,      LOG_WARN,  "%ld log records dropped") \
+  X(move_pos,     LOG_DEBUG, "push: %ld | rot: %ld") \
+  X(move_data,    LOG_DEBUG, "x: %ld| y: %ld") \
+  X(mode_switch,  LOG_INFO,  "Mode %ld -> %ld in %ld ms, free heap %ld") \
+  X(heap_allocs,  LOG_INFO,  "allocs since boot %ld") \
+  X(stats_failed, LOG_WARN,  "stats flush failed") \
+  X(push_done,    LOG_DEBUG, "push from %ld: switch off after %ld ms") \
+  X(mode_stuck,   LOG_ERROR, "mode tasks 0x%lx did not stop, restarting")
+
+#endif
@@ -0,0 +1,80 @@
+#include "modes.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#define mode_poll 10   // [ms]
+
+const char *mode_name(uint8_t mode){
+  switch(mode)
+  {
+    case 0: return "Touch";
+    case 2: return "Move";
+    case 4: return "Config";
+    case 6: return "Kiosk";
+    case 8: return "No Touch";
+  }
+  return "None";
+}
+
+int mode_from_name(const char *name){
+  if(strcmp(name, "touch") == 0){return 0;}
+  if(strcmp(name, "notouch") == 0){return 8;}
+  if(strcmp(name, "config") == 0){return 4;}
+  if(strcmp(name, "move") == 0){return 2;}
+  if(strcmp(name, "kiosk") == 0){return 6;}
+  return -1;
+}
+
+uint8_t mode_tasks(uint8_t mode){
+  switch(mode)
+  {
+    case 0:
+    case 6: return 1<<MODE_TOUCH | 1<<MODE_BASE;
+    case 8: return 1<<MODE_BASE;
+    case 4: return 1<<MODE_CONFIG;
+    case 2: return 1<<MODE_TOUCH | 1<<MODE_MOVE;
+  }
+  return 0;
+}
+
+void mode_init(mode_runner &runner, const mode_ops *ops){
+  memset((void*)&runner, 0, sizeof(runner));
+  runner.ops = ops;
+}
+
+void mode_start(mode_runner &runner, uint8_t mode){
+  runner.stop = false;
+  uint8_t tasks = mode_tasks(mode);
+  for(int i=0; i<MODE_TASKS; i++){
+    if(!(tasks & 1<<i) || runner.handle[i] != NULL){continue;}
+    runner.handle[i] = runner.ops->start(i);
+    if(runner.handle[i] != NULL){runner.starts[i]++;}
+  }
+}
+
+uint8_t mode_running(const mode_runner &runner){
+  uint8_t running = 0;
+  for(int i=0; i<MODE_TASKS; i++){
+    if(runner.handle[i] != NULL){running |= 1<<i;}
+  }
+  return running;
+}
+
+bool mode_stop(mode_runner &runner, uint32_t timeout){
+  runner.stop = true;
+  uint32_t start = runner.ops->millis();
+  while(mode_running(runner)){
+    if(runner.ops->millis() - start >= timeout){
+      runner.ops->restart(mode_running(runner));
+      return false;
+    }
+    runner.ops->wait(mode_poll);
+  }
+  return true;
+}
+
+void mode_task_done(mode_runner &runner, uint8_t task){
+  runner.exits[task]++;
+  runner.handle[task] = NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef MODES_H
+#define MODES_H
+
+// Box modes and the bookkeeping of their tasks, without FreeRTOS.
+// start_mode()/stop_mode() in src/main.cpp create the tasks through
+// mode_ops, test/test_modes passes fakes.
+//
+// Modes are the boot switch bits: 0 Touch, 8 No Touch, 4 Config, 2 Move,
+// 6 Kiosk (Touch with the restart gesture disabled).
+
+#include <stdint.h>
+
+enum mode_task {
+  MODE_TOUCH,    // codeForTouchTask
+  MODE_BASE,     // codeForBaseTask
+  MODE_CONFIG,   // codeForConfigTask
+  MODE_MOVE,     // codeForMoveTask
+  MODE_TASKS
+};
+
+struct mode_ops {
+  // creates the task, NULL if that failed
+  void *(*start)(uint8_t task);
+  void (*wait)(uint32_t ms);
+  uint32_t (*millis)();
+  // tasks in running did not stop in time, the firmware restarts the box
+  void (*restart)(uint8_t running);
+};
+
+struct mode_runner {
+  const mode_ops *ops;
+  volatile bool stop;                  // tasks call mode_task_done and end at their next check
+  void *volatile handle[MODE_TASKS];   // NULL once the task is done
+  uint32_t starts[MODE_TASKS];         // since mode_init, exits are written by the task only
+  volatile uint32_t exits[MODE_TASKS];
+};
+
+const char *mode_name(uint8_t mode);
+// names used by GET /mode?m=, -1 if unknown
+int mode_from_name(const char *name);
+// bit (1 << mode_task) per task the mode runs, 0 for unknown modes
+uint8_t mode_tasks(uint8_t mode);
+
+void mode_init(mode_runner &runner, const mode_ops *ops);
+
+// starts the tasks of mode in mode_task order
+void mode_start(mode_runner &runner, uint8_t mode);
+
+// Sets stop and polls every 10 ms until all tasks are done.
+// If some are still running after timeout ms it calls ops->restart,
+// returns false if that returns.
+bool mode_stop(mode_runner &runner, uint32_t timeout);
+
+// tasks that have not called mode_task_done yet, as in mode_tasks
+uint8_t mode_running(const mode_runner &runner);
+
+// called by the task itself right before it ends
+void mode_task_done(mode_runner &runner, uint8_t task);
+
+#endif
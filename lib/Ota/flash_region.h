@@ -0,0 +1,20 @@
+#ifndef FLASH_REGION_H
+#define FLASH_REGION_H
+
+// NOR flash area: erase sets sectors to 0xff, write can only clear bits.
+// Implemented by ota_partition.h on the ESP32 and by file stand-ins on the host.
+
+#include <stddef.h>
+#include <stdint.h>
+
+class flash_region {
+public:
+  virtual ~flash_region(){}
+  virtual size_t size() = 0;
+  virtual size_t sector_size() = 0;
+  virtual bool erase(size_t offset, size_t len) = 0;
+  virtual bool write(size_t offset, const uint8_t *data, size_t len) = 0;
+  virtual bool read(size_t offset, uint8_t *data, size_t len) = 0;
+};
+
+#endif
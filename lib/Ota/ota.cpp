@@ -0,0 +1,130 @@
+#include "ota.h"
+
+#include <string.h>
+
+static bool fail(ota_writer &ota, uint8_t error){
+  ota.error = error;
+  ota.active = false;
+  return false;
+}
+
+static bool flush(ota_writer &ota){
+  if(ota.fill == 0){return true;}
+  if(ota.written + ota.fill > ota.region->size()){
+    return fail(ota, OTA_ERR_SIZE);
+  }
+  while(ota.erased < ota.written + ota.fill){
+    size_t sector = ota.region->sector_size();
+    if(!ota.region->erase(ota.erased, sector)){
+      return fail(ota, OTA_ERR_ERASE);
+    }
+    ota.erased += sector;
+  }
+  if(!ota.region->write(ota.written, ota.chunk, ota.fill)){
+    return fail(ota, OTA_ERR_WRITE);
+  }
+  sha256_update(ota.sha, ota.chunk, ota.fill);
+  ota.written += ota.fill;
+  ota.fill = 0;
+  return true;
+}
+
+void ota_begin(ota_writer &ota, flash_region *region){
+  ota.region = region;
+  ota.written = 0;
+  ota.erased = 0;
+  ota.fill = 0;
+  ota.error = OTA_OK;
+  ota.active = true;
+  sha256_init(ota.sha);
+}
+
+bool ota_write(ota_writer &ota, const uint8_t *data, size_t len){
+  if(!ota.active){
+    if(ota.error == OTA_OK){ota.error = OTA_ERR_STATE;}
+    return false;
+  }
+  while(len){
+    size_t n = OTA_CHUNK - ota.fill < len ? OTA_CHUNK - ota.fill : len;
+    memcpy(ota.chunk + ota.fill, data, n);
+    ota.fill += n;
+    data += n;
+    len -= n;
+    if(ota.fill == OTA_CHUNK && !flush(ota)){
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ota_finish(ota_writer &ota, const uint8_t expected[SHA256_SIZE]){
+  if(!ota.active){
+    if(ota.error == OTA_OK){ota.error = OTA_ERR_STATE;}
+    return false;
+  }
+  if(!flush(ota)){return false;}
+
+  uint8_t hash[SHA256_SIZE];
+  sha256_final(ota.sha, hash);
+  if(memcmp(hash, expected, SHA256_SIZE) != 0){
+    return fail(ota, OTA_ERR_HASH);
+  }
+
+  //read back in chunks, the flash has to hold what was streamed
+  sha256_init(ota.sha);
+  for(size_t pos=0; pos<ota.written; pos+=OTA_CHUNK){
+    size_t n = ota.written - pos < OTA_CHUNK ? ota.written - pos : OTA_CHUNK;
+    if(!ota.region->read(pos, ota.chunk, n)){
+      return fail(ota, OTA_ERR_READ);
+    }
+    sha256_update(ota.sha, ota.chunk, n);
+  }
+  sha256_final(ota.sha, hash);
+  if(memcmp(hash, expected, SHA256_SIZE) != 0){
+    return fail(ota, OTA_ERR_VERIFY);
+  }
+  ota.active = false;
+  return true;
+}
+
+void ota_abort(ota_writer &ota){
+  ota.active = false;
+}
+
+size_t ota_size(const ota_writer &ota){
+  return ota.written + ota.fill;
+}
+
+const char *ota_error_name(uint8_t error){
+  switch(error)
+  {
+    case OTA_OK: return "ok";
+    case OTA_ERR_SIZE: return "image too large";
+    case OTA_ERR_ERASE: return "erase failed";
+    case OTA_ERR_WRITE: return "write failed";
+    case OTA_ERR_READ: return "read failed";
+    case OTA_ERR_HASH: return "sha256 mismatch";
+    case OTA_ERR_VERIFY: return "verify failed";
+    case OTA_ERR_STATE: return "no update running";
+  }
+  return "unknown";
+}
+
+void ota_boot_updated(ota_boot_state &state, const char *running){
+  strncpy(state.previous, running, OTA_LABEL_SIZE-1);
+  state.previous[OTA_LABEL_SIZE-1] = 0;
+  state.tries = 0;
+}
+
+bool ota_boot_failed(ota_boot_state &state){
+  if(state.previous[0] == 0){
+    return false;
+  }
+  state.tries++;
+  return state.tries > OTA_BOOT_TRIES;
+}
+
+void ota_boot_confirm(ota_boot_state &state){
+  state.previous[0] = 0;
+  state.tries = 0;
+}
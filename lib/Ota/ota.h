@@ -0,0 +1,73 @@
+#ifndef OTA_H
+#define OTA_H
+
+// Streams an image into a flash_region in fixed-size chunks.
+// Sectors are erased just before they are written, the SHA-256 is
+// updated per chunk and checked again by reading the region back.
+// Nothing larger than one chunk is buffered.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "flash_region.h"
+#include "sha256.h"
+
+#define OTA_CHUNK 1024
+
+enum ota_error {
+  OTA_OK,
+  OTA_ERR_SIZE,      // image larger than the region
+  OTA_ERR_ERASE,
+  OTA_ERR_WRITE,
+  OTA_ERR_READ,
+  OTA_ERR_HASH,      // streamed data does not match the expected hash
+  OTA_ERR_VERIFY,    // read back does not match the streamed data
+  OTA_ERR_STATE      // ota_write/ota_finish without ota_begin
+};
+
+struct ota_writer {
+  flash_region *region;
+  size_t written;    // bytes in flash
+  size_t erased;     // bytes erased from the start
+  sha256_ctx sha;
+  uint8_t chunk[OTA_CHUNK];
+  size_t fill;
+  uint8_t error;
+  bool active;
+};
+
+void ota_begin(ota_writer &ota, flash_region *region);
+
+// Accepts any piece size, writes whenever a chunk is complete
+bool ota_write(ota_writer &ota, const uint8_t *data, size_t len);
+
+// Writes the last chunk and verifies the image against expected
+bool ota_finish(ota_writer &ota, const uint8_t expected[SHA256_SIZE]);
+
+void ota_abort(ota_writer &ota);
+
+size_t ota_size(const ota_writer &ota);
+const char *ota_error_name(uint8_t error);
+
+// Software rollback of a firmware update, the Arduino bootloader is built
+// without CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE. main.cpp keeps the state in NVS.
+
+#define OTA_BOOT_TRIES 3   // boots of a new firmware before falling back to the previous one
+#define OTA_LABEL_SIZE 17  // partition label with terminator
+
+struct ota_boot_state {
+  char previous[OTA_LABEL_SIZE];   // partition to fall back to, "" once confirmed
+  uint8_t tries;                   // boots of the new firmware so far
+};
+
+// After a verified firmware update, running is the partition label booted now
+void ota_boot_updated(ota_boot_state &state, const char *running);
+
+// Counts a boot, first thing in setup(). Returns true when the new firmware
+// used up its tries: boot state.previous again and forget the update.
+bool ota_boot_failed(ota_boot_state &state);
+
+// The new firmware works, no rollback any more
+void ota_boot_confirm(ota_boot_state &state);
+
+#endif
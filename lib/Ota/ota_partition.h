@@ -0,0 +1,35 @@
+#ifndef OTA_PARTITION_H
+#define OTA_PARTITION_H
+
+// flash_region on top of an ESP32 partition
+
+#include <esp_partition.h>
+#include <esp_spi_flash.h>
+
+#include "flash_region.h"
+
+class partition_region : public flash_region {
+public:
+  partition_region() : part(NULL) {}
+
+  void select(const esp_partition_t *partition){part = partition;}
+  const esp_partition_t *partition(){return part;}
+
+  size_t size(){return part ? part->size : 0;}
+  size_t sector_size(){return SPI_FLASH_SEC_SIZE;}
+
+  bool erase(size_t offset, size_t len){
+    return part && esp_partition_erase_range(part, offset, len) == ESP_OK;
+  }
+  bool write(size_t offset, const uint8_t *data, size_t len){
+    return part && esp_partition_write(part, offset, data, len) == ESP_OK;
+  }
+  bool read(size_t offset, uint8_t *data, size_t len){
+    return part && esp_partition_read(part, offset, data, len) == ESP_OK;
+  }
+
+private:
+  const esp_partition_t *part;
+};
+
+#endif
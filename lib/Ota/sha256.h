@@ -0,0 +1,26 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+// Small incremental SHA-256, shared by firmware and host tools.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32
+
+struct sha256_ctx {
+  uint32_t state[8];
+  uint64_t length;
+  uint8_t block[64];
+  size_t fill;
+};
+
+void sha256_init(sha256_ctx &ctx);
+void sha256_update(sha256_ctx &ctx, const uint8_t *data, size_t len);
+void sha256_final(sha256_ctx &ctx, uint8_t hash[SHA256_SIZE]);
+
+// hex <-> binary, hex must have 2*SHA256_SIZE digits
+bool sha256_from_hex(const char *hex, uint8_t hash[SHA256_SIZE]);
+void sha256_to_hex(const uint8_t hash[SHA256_SIZE], char hex[2*SHA256_SIZE+1]);
+
+#endif
@@ -0,0 +1,135 @@
+#include "stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *mode_keys[STATS_MODES] = {"touch", "move", "config", "kiosk", "notouch"};
+
+void stats_init(stats_record &rec, stats_tracker &t){
+  memset(&rec, 0, sizeof(rec));
+  memset(&t, 0, sizeof(t));
+}
+
+void stats_switches(stats_record &rec, stats_tracker &t, switchmap_t last, switchmap_t switches, uint32_t now){
+  for(int i=0; i<SWITCH_COUNT; i++){
+    switchmap_t bit = 1 << (SWITCH_COUNT-1-i);
+    if((switches & bit) && !(last & bit)){
+      rec.flips[i]++;
+      t.on_since[i] = now;
+      t.tried &= ~bit;
+    }
+    else if(!(switches & bit) && (last & bit)){
+      if(!(t.tried & bit)){
+        rec.guard_wins++;
+        continue;
+      }
+      uint32_t ms = now - t.on_since[i];
+      int b = 0;
+      while(b < STATS_LATENCY_BUCKETS-1 && ms >= (256UL << b)){
+        b++;
+      }
+      rec.latency[b]++;
+    }
+  }
+}
+
+void stats_reset(stats_tracker &t, uint8_t target){
+  t.tried |= 1 << (SWITCH_COUNT-1-target);
+}
+
+void stats_time(stats_record &rec, stats_tracker &t, uint8_t mode, uint32_t elapsed){
+  t.mode_ms += elapsed;
+  rec.mode_seconds[(mode/2) % STATS_MODES] += t.mode_ms / 1000;
+  t.mode_ms %= 1000;
+}
+
+// all counters in format order
+static void to_words(const stats_record &rec, uint32_t *w){
+  int n = 0;
+  w[n++] = rec.boots;
+  for(int i=0; i<SWITCH_COUNT; i++){w[n++] = rec.flips[i];}
+  for(int i=0; i<STATS_LATENCY_BUCKETS; i++){w[n++] = rec.latency[i];}
+  w[n++] = rec.guard_wins;
+  for(int i=0; i<STATS_MODES; i++){w[n++] = rec.mode_seconds[i];}
+}
+
+static void from_words(stats_record &rec, const uint32_t *w){
+  int n = 0;
+  rec.boots = w[n++];
+  for(int i=0; i<SWITCH_COUNT; i++){rec.flips[i] = w[n++];}
+  for(int i=0; i<STATS_LATENCY_BUCKETS; i++){rec.latency[i] = w[n++];}
+  rec.guard_wins = w[n++];
+  for(int i=0; i<STATS_MODES; i++){rec.mode_seconds[i] = w[n++];}
+}
+
+void stats_merge(stats_record &into, const stats_record &add){
+  uint32_t a[STATS_WORDS], b[STATS_WORDS];
+  to_words(into, a);
+  to_words(add, b);
+  for(int i=0; i<STATS_WORDS; i++){
+    a[i] += b[i];
+  }
+  from_words(into, a);
+}
+
+void stats_encode(const stats_record &rec, uint8_t *out){
+  uint8_t head[8] = {'U', 'B', 'S', STATS_VERSION, SWITCH_COUNT, STATS_LATENCY_BUCKETS, STATS_MODES, 0};
+  memcpy(out, head, 8);
+  uint32_t w[STATS_WORDS];
+  to_words(rec, w);
+  for(int i=0; i<STATS_WORDS; i++){
+    uint8_t *p = out + 8 + 4*i;
+    p[0] = w[i];
+    p[1] = w[i] >> 8;
+    p[2] = w[i] >> 16;
+    p[3] = w[i] >> 24;
+  }
+}
+
+bool stats_decode(const uint8_t *in, size_t len, stats_record &rec){
+  uint8_t head[8] = {'U', 'B', 'S', STATS_VERSION, SWITCH_COUNT, STATS_LATENCY_BUCKETS, STATS_MODES, 0};
+  if(len < STATS_SIZE || memcmp(in, head, 8) != 0){
+    return false;
+  }
+  uint32_t w[STATS_WORDS];
+  for(int i=0; i<STATS_WORDS; i++){
+    const uint8_t *p = in + 8 + 4*i;
+    w[i] = p[0] | p[1]<<8 | (uint32_t)p[2]<<16 | (uint32_t)p[3]<<24;
+  }
+  from_words(rec, w);
+  return true;
+}
+
+static void write_text(stats_writer write, void *ctx, const char *text){
+  write(text, strlen(text), ctx);
+}
+
+static void write_list(stats_writer write, void *ctx, const char *key, const uint32_t *val, int n){
+  char buffer[16];
+  write_text(write, ctx, key);
+  for(int i=0; i<n; i++){
+    snprintf(buffer, sizeof(buffer), i ? ",%lu" : "%lu", (unsigned long)val[i]);
+    write_text(write, ctx, buffer);
+  }
+  write_text(write, ctx, "]");
+}
+
+void stats_json(const stats_record &rec, stats_writer write, void *ctx){
+  char buffer[48];
+  uint32_t bounds[STATS_LATENCY_BUCKETS-1];
+  for(int i=0; i<STATS_LATENCY_BUCKETS-1; i++){
+    bounds[i] = 256UL << i;
+  }
+  snprintf(buffer, sizeof(buffer), "{\"version\":%d,\"boots\":%lu", STATS_VERSION, (unsigned long)rec.boots);
+  write_text(write, ctx, buffer);
+  write_list(write, ctx, ",\"flips\":[", rec.flips, SWITCH_COUNT);
+  write_list(write, ctx, ",\"latency\":[", rec.latency, STATS_LATENCY_BUCKETS);
+  write_list(write, ctx, ",\"latency_bounds_ms\":[", bounds, STATS_LATENCY_BUCKETS-1);
+  snprintf(buffer, sizeof(buffer), ",\"guard_wins\":%lu,\"mode_seconds\":{", (unsigned long)rec.guard_wins);
+  write_text(write, ctx, buffer);
+  for(int i=0; i<STATS_MODES; i++){
+    snprintf(buffer, sizeof(buffer), "%s\"%s\":%lu", i ? "," : "", mode_keys[i], (unsigned long)rec.mode_seconds[i]);
+    write_text(write, ctx, buffer);
+  }
+  write_text(write, ctx, "}}\n");
+}
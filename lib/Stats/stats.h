@@ -0,0 +1,56 @@
+#ifndef STATS_H
+#define STATS_H
+
+// Usage analytics: counters aggregated in RAM since boot, added to the
+// totals from the stats log (stats_log.h) and exported by GET /stats.bin
+// and GET /stats.json.
+//
+// Binary format (stats_encode), little endian:
+//   "UBS" version u8, switches u8, latency buckets u8, modes u8, 0 u8,
+//   then u32 boots, flips * switches, latency * buckets, guard_wins,
+//   mode_seconds * modes
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <board.h>
+
+#define STATS_VERSION 1
+#define STATS_LATENCY_BUCKETS 8   // bucket i: reset within (256 << i) ms, the last one is open
+#define STATS_MODES 5             // user_mode/2: Touch, Move, Config, Kiosk, No Touch
+#define STATS_WORDS (2 + SWITCH_COUNT + STATS_LATENCY_BUCKETS + STATS_MODES)
+#define STATS_SIZE (8 + 4*STATS_WORDS)
+
+struct stats_record {
+  uint32_t boots;
+  uint32_t flips[SWITCH_COUNT];             // switch turned on
+  uint32_t latency[STATS_LATENCY_BUCKETS];  // switch on until the arm turned it off
+  uint32_t guard_wins;                      // switch turned off again without the arm ever going for it
+  uint32_t mode_seconds[STATS_MODES];
+};
+
+// base task state between two stats_switches calls
+struct stats_tracker {
+  uint32_t on_since[SWITCH_COUNT];
+  switchmap_t tried;      // switches the arm was sent to reset
+  uint32_t mode_ms;       // time not yet counted in mode_seconds
+};
+
+void stats_init(stats_record &rec, stats_tracker &t);
+
+// Base task, only when the switchmap changed
+void stats_switches(stats_record &rec, stats_tracker &t, switchmap_t last, switchmap_t switches, uint32_t now);
+// Base task, BASE_RESET for target
+void stats_reset(stats_tracker &t, uint8_t target);
+// loop(), elapsed ms in mode
+void stats_time(stats_record &rec, stats_tracker &t, uint8_t mode, uint32_t elapsed);
+
+void stats_merge(stats_record &into, const stats_record &add);
+
+void stats_encode(const stats_record &rec, uint8_t *out);
+bool stats_decode(const uint8_t *in, size_t len, stats_record &rec);
+
+typedef void (*stats_writer)(const char *text, size_t len, void *ctx);
+void stats_json(const stats_record &rec, stats_writer write, void *ctx);
+
+#endif
@@ -0,0 +1,121 @@
+#include "stats_log.h"
+
+#include <string.h>
+
+static uint32_t crc32(const uint8_t *data, size_t len){
+  uint32_t crc = 0xffffffff;
+  for(size_t i=0; i<len; i++){
+    crc ^= data[i];
+    for(int b=0; b<8; b++){
+      crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+  }
+  return ~crc;
+}
+
+static void put_u32(uint8_t *out, uint32_t val){
+  out[0] = val;
+  out[1] = val >> 8;
+  out[2] = val >> 16;
+  out[3] = val >> 24;
+}
+
+static uint32_t get_u32(const uint8_t *in){
+  return in[0] | in[1]<<8 | (uint32_t)in[2]<<16 | (uint32_t)in[3]<<24;
+}
+
+static size_t per_sector(flash_region *flash){
+  return flash->sector_size() / STATS_ENTRY_SIZE;
+}
+
+static size_t sectors(flash_region *flash){
+  return flash->size() / flash->sector_size();
+}
+
+// offset of the entry after the one at offset, wraps to the region start
+static size_t next_entry(flash_region *flash, size_t offset){
+  size_t sector = offset / flash->sector_size();
+  size_t slot = (offset % flash->sector_size()) / STATS_ENTRY_SIZE + 1;
+  if(slot == per_sector(flash)){
+    return ((sector+1) % sectors(flash)) * flash->sector_size();
+  }
+  return sector * flash->sector_size() + slot * STATS_ENTRY_SIZE;
+}
+
+static bool blank(const uint8_t *entry){
+  for(int i=0; i<STATS_ENTRY_SIZE; i++){
+    if(entry[i] != 0xff){return false;}
+  }
+  return true;
+}
+
+static bool valid(const uint8_t *entry, stats_record &rec){
+  return get_u32(entry+STATS_ENTRY_SIZE-4) == crc32(entry, STATS_ENTRY_SIZE-4) &&
+         stats_decode(entry+4, STATS_SIZE, rec);
+}
+
+bool stats_log_open(stats_log &log, flash_region *flash, stats_record &total){
+  log.flash = flash;
+  log.next = 0;
+  log.seq = 0;
+  log.entries = 0;
+  memset(&total, 0, sizeof(total));
+  if(sectors(flash) < 2 || per_sector(flash) < 1){
+    return false;
+  }
+
+  uint8_t entry[STATS_ENTRY_SIZE];
+  stats_record rec;
+  bool found = false;
+  size_t newest = 0;
+  for(size_t s=0; s<sectors(flash); s++){
+    for(size_t k=0; k<per_sector(flash); k++){
+      size_t offset = s * flash->sector_size() + k * STATS_ENTRY_SIZE;
+      if(!flash->read(offset, entry, STATS_ENTRY_SIZE) || !valid(entry, rec)){continue;}
+      log.entries++;
+      uint32_t seq = get_u32(entry);
+      if(!found || seq > log.seq){
+        found = true;
+        log.seq = seq;
+        newest = offset;
+        total = rec;
+      }
+    }
+  }
+  if(!found){
+    return true;
+  }
+
+  //continue behind the newest entry, skipping torn ones in its sector
+  log.next = next_entry(flash, newest);
+  while(log.next % flash->sector_size() != 0){
+    if(flash->read(log.next, entry, STATS_ENTRY_SIZE) && blank(entry)){break;}
+    log.next = next_entry(flash, log.next);
+  }
+  return true;
+}
+
+bool stats_log_append(stats_log &log, const stats_record &total){
+  flash_region *flash = log.flash;
+  uint8_t entry[STATS_ENTRY_SIZE];
+  uint8_t check[STATS_ENTRY_SIZE];
+  put_u32(entry, log.seq+1);
+  stats_encode(total, entry+4);
+  put_u32(entry+STATS_ENTRY_SIZE-4, crc32(entry, STATS_ENTRY_SIZE-4));
+
+  //a failed entry is skipped, give up after one sector worth of tries
+  for(size_t tries=0; tries<=per_sector(flash); tries++){
+    size_t offset = log.next;
+    if(offset % flash->sector_size() == 0 && !flash->erase(offset, flash->sector_size())){
+      return false;
+    }
+    log.next = next_entry(flash, offset);
+    if(flash->write(offset, entry, STATS_ENTRY_SIZE) &&
+       flash->read(offset, check, STATS_ENTRY_SIZE) &&
+       memcmp(entry, check, STATS_ENTRY_SIZE) == 0){
+      log.seq++;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,37 @@
+#ifndef STATS_LOG_H
+#define STATS_LOG_H
+
+// Append log of stats_record totals in a flash_region (partition "stats").
+//
+// Entry, fixed size, never across a sector:
+//   seq u32, record (stats_encode), crc32 u32 over seq and record
+// The valid entry with the highest seq is the total, older entries are
+// history. Appends go round robin through all sectors and a sector is
+// erased when the log enters it again, so all sectors wear the same and
+// compaction is just that erase. A torn write fails the crc and the
+// previous entry is used.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <flash_region.h>
+
+#include "stats.h"
+
+#define STATS_ENTRY_SIZE (4 + STATS_SIZE + 4)
+
+struct stats_log {
+  flash_region *flash;
+  size_t next;        // offset of the next entry, erase first at a sector start
+  uint32_t seq;       // of the newest entry
+  uint32_t entries;   // valid entries found by stats_log_open
+};
+
+// Scans the region, total is the newest valid entry or all zero.
+// false if the region has less than two sectors.
+bool stats_log_open(stats_log &log, flash_region *flash, stats_record &total);
+
+// Writes total as the newest entry, verified by reading it back
+bool stats_log_append(stats_log &log, const stats_record &total);
+
+#endif
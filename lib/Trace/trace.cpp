@@ -0,0 +1,222 @@
+#include "trace.h"
+
+#include <string.h>
+
+static size_t put_varint(uint8_t *out, uint32_t val){
+  size_t n = 0;
+  while(val >= 0x80){
+    out[n++] = (val & 0x7f) | 0x80;
+    val >>= 7;
+  }
+  out[n++] = val;
+  return n;
+}
+
+static bool get_varint(const uint8_t *in, size_t len, size_t &pos, uint32_t &val){
+  val = 0;
+  for(int shift=0; shift<35; shift+=7){
+    if(pos >= len){return false;}
+    uint8_t b = in[pos++];
+    val |= (uint32_t)(b & 0x7f) << shift;
+    if(!(b & 0x80)){return true;}
+  }
+  return false;
+}
+
+static uint32_t zigzag(int32_t val){
+  return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+}
+
+static int32_t unzigzag(uint32_t val){
+  return (int32_t)(val >> 1) ^ -(int32_t)(val & 1);
+}
+
+static void put_u16(uint8_t *out, uint16_t val){
+  out[0] = val;
+  out[1] = val >> 8;
+}
+
+static uint16_t get_u16(const uint8_t *in){
+  return in[0] | in[1]<<8;
+}
+
+static size_t put_keyframe(uint8_t *out, const trace_sample &s){
+  put_u16(out, s.time);
+  put_u16(out+2, s.time >> 16);
+  for(int i=0; i<TRACE_CHANNELS; i++){
+    put_u16(out+4+2*i, s.touch[i]);
+  }
+  put_u16(out+TRACE_KEYFRAME_SIZE-2, s.switches);
+  return TRACE_KEYFRAME_SIZE;
+}
+
+static void get_keyframe(const uint8_t *in, trace_sample &s){
+  s.time = get_u16(in) | (uint32_t)get_u16(in+2)<<16;
+  for(int i=0; i<TRACE_CHANNELS; i++){
+    s.touch[i] = get_u16(in+4+2*i);
+  }
+  s.switches = get_u16(in+TRACE_KEYFRAME_SIZE-2);
+}
+
+void trace_init(trace_buffer &tb, uint8_t deadband, uint16_t period){
+  memset(&tb, 0, sizeof(tb));
+  tb.deadband = deadband;
+  tb.period = period;
+}
+
+static size_t put_sample(trace_buffer &tb, const trace_sample &sample){
+  uint8_t *block = tb.data[(tb.blocks-1) % TRACE_BLOCKS];
+  uint16_t &used = tb.used[(tb.blocks-1) % TRACE_BLOCKS];
+
+  if(tb.blocks == 0 || used + TRACE_RECORD_MAX > TRACE_BLOCK_SIZE){
+    //start a new block, overwriting the oldest one
+    block = tb.data[tb.blocks % TRACE_BLOCKS];
+    tb.used[tb.blocks % TRACE_BLOCKS] = put_keyframe(block, sample);
+    tb.blocks++;
+    tb.last = sample;
+    return TRACE_KEYFRAME_SIZE;
+  }
+
+  //a recorded value trails the sample by deadband-1, so flicker around a
+  //level does not walk the stored value to its edge and keep recording
+  int lag = tb.deadband > 1 ? tb.deadband - 1 : 0;
+  int step[TRACE_CHANNELS];
+  uint32_t mask = 0;
+  for(int i=0; i<TRACE_CHANNELS; i++){
+    int diff = (int)sample.touch[i] - tb.last.touch[i];
+    step[i] = diff > lag ? diff - lag : diff < -lag ? diff + lag : 0;
+    if(step[i] != 0){
+      mask |= 1<<i;
+    }
+  }
+  if(sample.switches != tb.last.switches){
+    mask |= 1<<TRACE_CHANNELS;
+  }
+  if(mask == 0){
+    return 0;
+  }
+
+  size_t n = used;
+  n += put_varint(block+n, mask);
+  n += put_varint(block+n, sample.time - tb.last.time);
+  for(int i=0; i<TRACE_CHANNELS; i++){
+    if(mask & 1<<i){
+      n += put_varint(block+n, zigzag(step[i]));
+      tb.last.touch[i] += step[i];
+    }
+  }
+  if(mask & 1<<TRACE_CHANNELS){
+    n += put_varint(block+n, sample.switches);
+    tb.last.switches = sample.switches;
+  }
+  tb.last.time = sample.time;
+
+  size_t written = n - used;
+  used = n;
+  return written;
+}
+
+size_t trace_record(trace_buffer &tb, const trace_sample &sample){
+  if(tb.period <= 1){
+    return put_sample(tb, sample);
+  }
+  if(tb.window_open && sample.switches == tb.window.switches && sample.time - tb.window.time < tb.period){
+    //keep the strongest touch of the window, read glitches only if nothing else came
+    for(int i=0; i<TRACE_CHANNELS; i++){
+      uint16_t &held = tb.window.touch[i];
+      if(sample.touch[i] > TRACE_GLITCH && (sample.touch[i] < held || held <= TRACE_GLITCH)){
+        held = sample.touch[i];
+      }
+    }
+    return 0;
+  }
+  //a switch change closes the window early, so flips keep their exact time
+  size_t written = tb.window_open ? put_sample(tb, tb.window) : 0;
+  tb.window = sample;
+  tb.window_open = true;
+  return written;
+}
+
+uint32_t trace_first_block(const trace_buffer &tb){
+  return tb.blocks > TRACE_BLOCKS ? tb.blocks - TRACE_BLOCKS : 0;
+}
+
+size_t trace_dump_size(const trace_buffer &tb){
+  size_t size = TRACE_HEAD_SIZE;
+  for(uint32_t b=trace_first_block(tb); b<tb.blocks; b++){
+    size += 2 + tb.used[b % TRACE_BLOCKS];
+  }
+  return size;
+}
+
+size_t trace_dump_head(uint8_t *out){
+  memcpy(out, "UBT", 3);
+  out[3] = TRACE_VERSION;
+  out[4] = TRACE_CHANNELS;
+  put_u16(out+5, TRACE_BLOCK_SIZE);
+  return TRACE_HEAD_SIZE;
+}
+
+size_t trace_dump_block(const trace_buffer &tb, uint32_t b, uint8_t *out){
+  if(b < trace_first_block(tb) || b >= tb.blocks){
+    return 0;
+  }
+  uint16_t used = tb.used[b % TRACE_BLOCKS];
+  put_u16(out, used);
+  memcpy(out+2, tb.data[b % TRACE_BLOCKS], used);
+  return 2 + used;
+}
+
+void trace_dump(const trace_buffer &tb, trace_writer write, void *ctx){
+  uint8_t out[2 + TRACE_BLOCK_SIZE];
+  write(out, trace_dump_head(out), ctx);
+  for(uint32_t b=trace_first_block(tb); b<tb.blocks; b++){
+    write(out, trace_dump_block(tb, b, out), ctx);
+  }
+}
+
+static bool parse_block(const uint8_t *in, size_t len, trace_reader read, void *ctx, long &count){
+  if(len < TRACE_KEYFRAME_SIZE){return false;}
+  trace_sample s;
+  get_keyframe(in, s);
+  read(s, ctx);
+  count++;
+
+  size_t pos = TRACE_KEYFRAME_SIZE;
+  while(pos < len){
+    uint32_t mask, dt, val;
+    if(!get_varint(in, len, pos, mask) || mask == 0 || mask >> (TRACE_CHANNELS+1)){return false;}
+    if(!get_varint(in, len, pos, dt)){return false;}
+    s.time += dt;
+    for(int i=0; i<TRACE_CHANNELS; i++){
+      if(mask & 1<<i){
+        if(!get_varint(in, len, pos, val)){return false;}
+        s.touch[i] += unzigzag(val);
+      }
+    }
+    if(mask & 1<<TRACE_CHANNELS){
+      if(!get_varint(in, len, pos, val)){return false;}
+      s.switches = val;
+    }
+    read(s, ctx);
+    count++;
+  }
+  return true;
+}
+
+long trace_parse(const uint8_t *data, size_t len, trace_reader read, void *ctx){
+  if(len < TRACE_HEAD_SIZE || memcmp(data, "UBT", 3) != 0 || data[3] != TRACE_VERSION || data[4] != TRACE_CHANNELS){
+    return -1;
+  }
+  long count = 0;
+  size_t pos = TRACE_HEAD_SIZE;
+  while(pos < len){
+    if(pos + 2 > len){return -1;}
+    size_t block_len = get_u16(data+pos);
+    pos += 2;
+    if(pos + block_len > len){return -1;}
+    if(!parse_block(data+pos, block_len, read, ctx, count)){return -1;}
+    pos += block_len;
+  }
+  return count;
+}
@@ -0,0 +1,80 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Sensor trace recorder: touch values and switch bitmaps, delta/varint
+// encoded into a ring of fixed-size blocks.
+//
+// Block layout:
+//   keyframe  time u32, touch u16 * TRACE_CHANNELS, switches u16 (little endian)
+//   records   varint mask, varint dt [ms], zigzag varint delta per changed
+//             touch channel (mask bit i), varint switches (mask bit TRACE_CHANNELS)
+// Unchanged samples are not written at all, so the next record's dt covers them.
+//
+// With a period > 1 only one sample per period [ms] is encoded: the window's
+// first time and switches with the lowest (strongest touched) value of each
+// channel. A switch change starts a new window. The open window is not in
+// the dump until the next one starts.
+//
+// Dump format (GET /trace.bin):
+//   "UBT" version u8, channels u8, block size u16, then per block length u16 + data
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <board.h>
+
+#define TRACE_CHANNELS SWITCH_COUNT
+#define TRACE_BLOCK_SIZE 256
+#define TRACE_BLOCKS 64
+#define TRACE_VERSION 2
+#define TRACE_DEADBAND 2 // touch task settings, 64 blocks hold about 6 h
+#define TRACE_PERIOD 50  // of a box in use, also with 16 switches
+#define TRACE_GLITCH 5   // touchRead() values <= 5 are read errors, see touch_update
+
+#define TRACE_HEAD_SIZE 7
+#define TRACE_KEYFRAME_SIZE (4 + 2*TRACE_CHANNELS + 2)
+#define TRACE_RECORD_MAX (3 + 5 + 3*TRACE_CHANNELS + 3)
+
+struct trace_sample {
+  uint32_t time;
+  uint16_t touch[TRACE_CHANNELS];
+  switchmap_t switches;
+};
+
+struct trace_buffer {
+  uint8_t data[TRACE_BLOCKS][TRACE_BLOCK_SIZE];
+  uint16_t used[TRACE_BLOCKS];
+  uint32_t blocks;      // blocks started since trace_init
+  trace_sample last;    // state the next record is encoded against
+  uint8_t deadband;     // recorded touch values stay within deadband-1
+  uint16_t period;      // window length [ms]
+  trace_sample window;  // window not encoded yet
+  bool window_open;
+};
+
+typedef void (*trace_writer)(const uint8_t *data, size_t len, void *ctx);
+typedef void (*trace_reader)(const trace_sample &sample, void *ctx);
+
+// deadband 0 or 1 records every change (lossless), period 0 or 1 every sample
+void trace_init(trace_buffer &tb, uint8_t deadband, uint16_t period);
+
+// Constant time per sample, returns bytes written (0 if nothing changed)
+size_t trace_record(trace_buffer &tb, const trace_sample &sample);
+
+// Writes the dump format, oldest block first
+void trace_dump(const trace_buffer &tb, trace_writer write, void *ctx);
+size_t trace_dump_size(const trace_buffer &tb);
+
+// The same dump piece by piece, for callers that cannot hold the buffer's
+// lock for a whole dump. Blocks are counted since trace_init, from
+// trace_first_block to tb.blocks-1. trace_dump_block copies the block with
+// its length into out (2 + TRACE_BLOCK_SIZE bytes), 0 if it was overwritten.
+size_t trace_dump_head(uint8_t *out);
+uint32_t trace_first_block(const trace_buffer &tb);
+size_t trace_dump_block(const trace_buffer &tb, uint32_t b, uint8_t *out);
+
+// Decodes a dump, calls read for every recorded sample.
+// Returns the number of samples or -1 on a malformed dump.
+long trace_parse(const uint8_t *data, size_t len, trace_reader read, void *ctx);
+
+#endif
@@ -1,6 +1,8 @@
 #include <Arduino.h>
 #include <Preferences.h>
 #include <SPIFFS.h>
+#include <esp_ota_ops.h>
+#include <soc/gpio_reg.h>
 #include <string>
 
 //Webserver
@@ -10,6 +12,19 @@
 #include <ESPAsyncWebServer.h> //Changed TEMPLATE_PLACEHOLDER in WebResponseImpl.h to "~"
 #include <DNSServer.h>
 
+#include <box_logic.h>
+#include <predict.h>
+#include <modes.h>
+#include <trace.h>
+#include <ota.h>
+#include <ota_partition.h>
+#include <box_routes.h>
+#include <async_http.h>
+#include <heap_guard.h>
+#include <stats.h>
+#include <stats_log.h>
+#include <log.h>
+
 //def pins
 #define arm_rot 22
 #define arm_push 23
@@ -19,28 +34,40 @@
 #define arm_push_id 2
 #define deckel_id 3
 
-//def Servo pulse
-#define arm_move_push_min 1100
-#define arm_move_push_max 1750
-#define arm_move_rot_min 750
-#define arm_move_rot_max 2450
-
+//def Servo pulse, limits in lib/BoxLogic/motion.h
 #define arm_rot_default 1300
-#define arm_pressed 1900 // kontakt 1830
-#define arm_waiting 1700
-
-#define deckel_min 1060
-#define deckel_auf 1600
-#define deckel_max 2100
+//pulses and delays: lib/BoxLogic/motion_profile.h, tools/motion_tune.cpp
+#define arm_pressed motion.arm_pressed
+#define arm_waiting motion.arm_waiting
 
 #define hz 50
 #define bit_res 12
 
-typedef std::function<String(const String&)> TemplateProcessor;
-
 Preferences preferences;
-SemaphoreHandle_t TouchLock;
-TaskHandle_t TouchTask, BaseTask, ConfigTask, MoveTask;
+SemaphoreHandle_t TouchLock, TraceLock;
+TaskHandle_t LogTask;
+
+#define touch_stack_size 1000
+#define base_stack_size 1000
+#define config_stack_size 3000
+#define move_stack_size 1000
+#define log_stack_size 2048
+
+#ifdef STATIC_ALLOC
+//no heap for tasks and locks, see heap_seal()
+StackType_t touch_stack[touch_stack_size], base_stack[base_stack_size];
+StackType_t config_stack[config_stack_size], move_stack[move_stack_size], log_stack[log_stack_size];
+StaticTask_t touch_tcb, base_tcb, config_tcb, move_tcb, log_tcb;
+StaticSemaphore_t touch_lock, trace_lock;
+#define start_task_prio(code, name, param, mem, handle, core, prio) \
+  handle = xTaskCreateStaticPinnedToCore(code, name, mem##_stack_size, param, prio, mem##_stack, &mem##_tcb, core)
+#define create_lock(mem) xSemaphoreCreateMutexStatic(&mem##_lock)
+#else
+#define start_task_prio(code, name, param, mem, handle, core, prio) \
+  xTaskCreatePinnedToCore(code, name, mem##_stack_size, param, prio, &handle, core)
+#define create_lock(mem) xSemaphoreCreateMutex()
+#endif
+#define start_task(code, name, param, mem, handle, core) start_task_prio(code, name, param, mem, handle, core, 1)
 AsyncWebServer server(80);
 DNSServer dnsServer;
 
@@ -48,24 +75,62 @@ IPAddress apIP(192, 168, 1, 1);
 IPAddress netMsk(255, 255, 255, 0);
 const byte DNS_PORT = 53;
 
-String switch_box;
-String info_box;
+// status box templates, loaded once by load_boxes()
+#define box_arena_size 4096
+char box_arena[box_arena_size];
+struct box_file {
+  const char *path;
+  const char *html;
+  size_t len;
+};
+box_file box_files[] = {{"/info_box.html", "", 0}, {"/switch_box.html", "", 0}, {"/config_box.html", "", 0}};
 
 bool server_active = false;
 unsigned long force_restart = 0;
 bool force_restart_active = true;
 bool serial_active = false;
 
-uint16_t config[4][3];
+ota_writer ota;
+partition_region ota_region;
+AsyncWebServerRequest *ota_request = NULL;
+uint8_t ota_hash[SHA256_SIZE];
+bool ota_assets = false;
+int ota_status = 500;           // HTTP status of the last POST /update
+const char *ota_result = "";
+unsigned long ota_restart = 0;
+char assets_part[8] = "spiffs";   // mounted asset partition, the other one takes uploads
+
+uint16_t config[SWITCH_COUNT][3];
 uint8_t config_default[2][3] = {{8,30,15},{12,21,18}};
 
 uint8_t user_extra = 0;
 uint8_t user_mode = 0;
 
-uint8_t switch_pins[4] = {17, 16, 4, 18}; //B1 17, B2 16, B3 4, B4 18
-uint8_t touch_pins[4] = {T4, T7, T6, T5};
-uint16_t switch_pos[4] = {850, 1300, 1850, 2400};
-uint16_t touch_status[4] = {0, 0, 0, 0};
+mode_runner modes;                 // tasks of user_mode, see lib/Modes
+#define mode_stop_timeout 5000     // longest stop check interval is the config task's pad loop [ms]
+volatile int mode_request = -1;    // mode change for loop(), -1 none
+volatile int conf_request = -1;    // 0 wired, 1 battery, -1 keep
+uint8_t mode_after_config = 0;
+unsigned long mode_gesture = 0;
+
+// pins and positions from the board descriptor, see lib/BoxLogic/board.h
+const uint8_t *switch_pins = board_switch_pins;
+const uint8_t *touch_pins = board_touch_pins;
+const uint16_t *switch_pos = board_switch_pos;
+uint16_t touch_status[SWITCH_COUNT];
+
+flip_model flips;
+trace_buffer trace;
+
+stats_record stats;          // since boot, written by the base task and loop()
+stats_record stats_base;     // total from the stats partition at boot
+stats_tracker stats_track;
+stats_log stats_flash;
+partition_region stats_region;
+bool stats_persist = false;
+unsigned long stats_flushed = 0;
+unsigned long stats_tick = 0;
+#define stats_flush_interval 600000
 
 bool prerun = false;
 bool sleeping = false;
@@ -74,6 +139,13 @@ int current_pos[3] = {0, 0, 0}; // rot, push, lid
 
 // config functions --------------------------------------------------
 
+// NVS keys s1_min .. s16_th, switches 1-9 keep the keys of older firmware
+void config_keys(int i, char *min, char *max, char *th){
+  snprintf(min, 8, "s%d_min", i+1);
+  snprintf(max, 8, "s%d_max", i+1);
+  snprintf(th, 8, "s%d_th", i+1);
+}
+
 void load_config(){
   uint8_t config_mode = 0;
   if((user_extra&2) == 2){
@@ -82,13 +154,9 @@ void load_config(){
   }
   else {preferences.begin("normal");}
 
-  char min[7] = "sx_min";
-  char max[7] = "sx_max";
-  char th[7] = "sx_th";
-  for(int i=0; i<4; i++){
-    min[1] = char(i+49);
-    max[1] = char(i+49);
-    th[1] = char(i+49);
+  char min[8], max[8], th[8];
+  for(int i=0; i<SWITCH_COUNT; i++){
+    config_keys(i, min, max, th);
     config[i][0] = preferences.getUChar(min, config_default[config_mode][0]);
     config[i][1] = preferences.getUChar(max, config_default[config_mode][1]);
     config[i][2] = preferences.getUChar(th, config_default[config_mode][2]);
@@ -103,13 +171,9 @@ void save_config(){
   else{
     preferences.begin("normal");
   }
-  char min[7] = "sx_min";
-  char max[7] = "sx_max";
-  char th[7] = "sx_th";
-  for(int i=0; i<4; i++){
-    min[1] = char(i+49);
-    max[1] = char(i+49);
-    th[1] = char(i+49);
+  char min[8], max[8], th[8];
+  for(int i=0; i<SWITCH_COUNT; i++){
+    config_keys(i, min, max, th);
     preferences.putUChar(min, config[i][0]);
     preferences.putUChar(max, config[i][1]);
     preferences.putUChar(th, config[i][2]);
@@ -118,19 +182,29 @@ void save_config(){
 }
 
 //switch base functions ----------------------------------------------
-bool is_pressed(uint8_t pos){
-  return !digitalRead(switch_pins[pos]);
+uint64_t read_gpio(){
+  //all switches with one register read, the second bank only if used
+  uint64_t in = REG_READ(GPIO_IN_REG);
+  if(board_switch_mask >> 32){
+    in |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+  }
+  return in;
 }
 
-uint8_t get_switchmap(){
-  uint8_t switchmap = 0;
-  for(int i=0; i<4; i++){
-    switchmap = switchmap | int(!digitalRead(switch_pins[i]))<<(3-i);
-  }
-  return switchmap;
+switchmap_t get_switchmap(){
+  return board_switchmap(read_gpio());
+}
+
+bool is_pressed(uint8_t pos){
+  return (get_switchmap()>>(SWITCH_COUNT-1-pos)) & 1;
 }
 
 //touch base functions -----------------------------------------------
+uint16_t read_touch(uint8_t pos){
+  if(touch_pins[pos] == TOUCH_NONE){return 0;}
+  return touchRead(touch_pins[pos]);
+}
+
 uint16_t is_touched(uint8_t pos){
   xSemaphoreTake(TouchLock, portMAX_DELAY);
   uint16_t status = touch_status[pos];
@@ -147,7 +221,7 @@ int calc_duty(int pulse, int freq, int res){
 bool set_lid(uint16_t pulse){
   if(pulse >= deckel_min && pulse <= deckel_max){
     ledcWrite(deckel_id, calc_duty(pulse, hz, bit_res));
-    delay(100);
+    delay(motion.settle);
     return true;
   }
   return false;
@@ -156,7 +230,7 @@ bool set_lid(uint16_t pulse){
 bool set_rot(uint16_t pulse){
   if(pulse >= arm_move_rot_min && pulse <= arm_move_rot_max){
     ledcWrite(arm_rot_id, calc_duty(pulse, hz, bit_res));
-    delay(100);
+    delay(motion.settle);
     return true;
   }
   return false;
@@ -165,7 +239,8 @@ bool set_rot(uint16_t pulse){
 bool set_push(uint16_t pulse, bool press = false){
   if(pulse >= arm_move_push_min && (pulse <= arm_move_push_max || (press && pulse <= arm_pressed))){
     ledcWrite(arm_push_id, calc_duty(pulse, hz, bit_res));
-    delay(100);
+    current_pos[1] = pulse;
+    delay(motion.settle);
     return true;
   }
   return false;
@@ -176,7 +251,7 @@ bool set_push(uint16_t pulse, bool press = false){
 void rotate_to_switch(uint8_t pos){
   if(pos != current_pos[0]){
     set_rot(switch_pos[pos]);
-    delay(abs(current_pos[0]-pos)*150);
+    delay(abs(current_pos[0]-pos)*motion.slot);
   }
   current_pos[0] = pos;
 }
@@ -184,7 +259,7 @@ void rotate_to_switch(uint8_t pos){
 void open_lid(){
   if(!current_pos[2]){
     set_lid(deckel_auf);
-    delay(100);
+    delay(motion.lid);
   }
   current_pos[2] = true;
 }
@@ -192,34 +267,37 @@ void open_lid(){
 void close_lid(bool force = false){
   if(current_pos[2] || force){
     set_lid(deckel_min);
-    delay(100);
+    delay(motion.lid);
   }
   current_pos[2] = false;
 }
 
 void push_switch(){
   if(is_touched(current_pos[0])){return;}
+  //push_done measures the push servo for tools/motion_tune.cpp
+  int from = current_pos[1];
+  unsigned long start = millis();
   set_push(arm_pressed, true);
-  current_pos[1] = arm_pressed;
   do{
-    if(is_touched(current_pos[0])){break;}
-    delay(100);
+    //a switch that does not go off must not keep stop_mode() waiting
+    if(is_touched(current_pos[0]) || modes.stop){break;}
+    delay(motion.push_poll);
   }while(is_pressed(current_pos[0]));
+  if(!is_pressed(current_pos[0])){LOG(push_done, from, millis()-start);}
   set_push(arm_waiting);
-  current_pos[1] = arm_waiting;
-  delay(100);
+  delay(motion.release);
 }
 
 void retreat(){
   set_push(arm_move_push_min);
-  delay(200);
+  delay(motion.retreat);
 }
 
 void home_pos(){
   //open lid
   open_lid();
   //reset switches
-  for(int i=0;i<4;i++){
+  for(int i=0;i<SWITCH_COUNT;i++){
     if(is_pressed(i)){
       rotate_to_switch(i);
       push_switch();
@@ -230,115 +308,273 @@ void home_pos(){
   close_lid();
 }
 
-//Server template processor-----------------------------------------------------------
+//Server status boxes-----------------------------------------------------------
 
-String html_config_processor(const String& var){
-  if(var.startsWith("cst")){
-    return String(config[int(var.charAt(var.length()-1))-48][0]);
+void box_snapshot(box_state &state, uint8_t parts){
+  //status boxes are rendered by lib/Http/box_routes.cpp
+  if(parts & BOX_INFO){
+    state.uptime = millis();
+    state.mode = mode_name(user_mode);
+    state.battery = (user_extra&2) == 2;
+    state.serial = serial_active;
+    state.reset = force_restart_active;
   }
-  else if(var.startsWith("csf")){
-    return String(config[int(var.charAt(var.length()-1))-48][1]);
+  if(parts & BOX_SWITCHES){
+    state.switches = get_switchmap();
+    for(int i=0; i<SWITCH_COUNT; i++){
+      state.touch_status[i] = is_touched(i);
+      state.touch_value[i] = read_touch(i);
+    }
   }
-  else if(var.startsWith("csh")){
-    return String(config[int(var.charAt(var.length()-1))-48][2]);
+  if(parts & BOX_CONFIG){
+    memcpy(state.config, config, sizeof(state.config));
   }
-  return String("N/A");
 }
 
-String html_switch_processor(const String& var){
-  if(var.startsWith("switch")){
-    return !digitalRead(switch_pins[int(var.charAt(var.length()-1))-48]) ? "true" : "false";
+const char *box_template(const char *file, size_t *len){
+  for(int i=0; i<3; i++){
+    if(strcmp(file, box_files[i].path) == 0){
+      *len = box_files[i].len;
+      return box_files[i].html;
+    }
   }
-  else if(var.startsWith("touch")){
-    return String(is_touched(int(var.charAt(var.length()-1))-48))+"s";
+  *len = 0;
+  return "";
+}
+
+void move_data(int x, int y){
+  LOG(move_data, x, y);
+}
+
+const box_app box = {box_snapshot, box_template, move_data};
+
+// spiffs functions--------------------------------------------------
+
+void load_boxes(){
+  //status box templates are expanded on every poll, keep them in RAM
+  size_t used = 0;
+  for(int i=0; i<3; i++){
+    box_files[i].html = box_arena + used;
+    box_files[i].len = 0;
+    File file = SPIFFS.open(box_files[i].path);
+    if(!file){continue;}
+    box_files[i].len = file.read((uint8_t*)box_arena + used, box_arena_size - used);
+    if(file.available() && serial_active){
+      Serial.print("box arena too small for ");
+      Serial.println(box_files[i].path);
+    }
+    file.close();
+    used += box_files[i].len;
   }
-  else if(var.startsWith("tval")){
-    return String(touchRead(touch_pins[int(var.charAt(var.length()-1))-48]));
+}
+
+void assets_mount(){
+  //serial uploadfs writes "spiffs", uploads alternate with "spiffs1",
+  //the nvs key "assets" in "ota" names the one to mount
+  preferences.begin("ota", true);
+  preferences.getString("assets", assets_part, sizeof(assets_part));
+  preferences.end();
+  if(!SPIFFS.begin(false, "/spiffs", 20, assets_part)){ // maxOpenFiles=20
+    strlcpy(assets_part, "spiffs", sizeof(assets_part));
+    SPIFFS.begin(false, "/spiffs", 20, assets_part);
   }
-  return String("N/A");
 }
 
-String html_info_processor(const String& var){
-  if(var == "uptime"){
-    int sec = millis() / 1000;
-    int min = sec / 60;
-    int hr = min / 60;
-    char buffer[10];
-    snprintf(buffer, 10, "%02d:%02d:%02d", hr, min % 60, sec % 60);
-    return String(buffer);
+const char *assets_spare(){
+  return strcmp(assets_part, "spiffs") == 0 ? "spiffs1" : "spiffs";
+}
+
+// ota functions-----------------------------------------------------
+// POST /update?target=firmware|assets&sha256=<hex> with the image as multipart file
+// Both targets are written next to the running image and only selected
+// after the hash matched, then the box restarts.
+
+void ota_boot_check(){
+  ota_boot_state boot = {"", 0};
+  preferences.begin("ota");
+  preferences.getString("previous", boot.previous, sizeof(boot.previous));
+  boot.tries = preferences.getUChar("tries", 0);
+  bool failed = ota_boot_failed(boot);
+  if(boot.previous[0] != 0){preferences.putUChar("tries", boot.tries);}
+  if(failed){preferences.remove("previous");}
+  preferences.end();
+  if(!failed){
+    return;
   }
-  else if (var == "mode"){
+  const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, boot.previous);
+  if(part != NULL && esp_ota_set_boot_partition(part) == ESP_OK){
+    ESP.restart();
+  }
+}
 
-    switch (user_mode)
-    {
-    case 0:
-      return "Touch";
-      break;
-    case 2:
-      return "Move";
-      break;
-    case 4:
-      return "Config";
-      break;
-    case 6:
-      return "Kiosk";
-      break;
-    case 8:
-      return "No Touch";
-      break;
-    }
-    return "None";
+void ota_boot_valid(){
+  preferences.begin("ota");
+  preferences.remove("previous");
+  preferences.end();
+  esp_ota_mark_app_valid_cancel_rollback();
+}
+
+void ota_start(AsyncWebServerRequest *request){
+  ota_status = 400;
+  if(!request->hasParam("sha256") || !sha256_from_hex(request->getParam("sha256")->value().c_str(), ota_hash)){
+    ota_result = "missing sha256";
+    return;
+  }
+  String target = request->hasParam("target") ? request->getParam("target")->value() : String("");
+  if(target != "firmware" && target != "assets"){
+    ota_result = "unknown target";
+    return;
+  }
+  ota_status = 500;
+  ota_assets = target == "assets";
+  const esp_partition_t *part;
+  if(ota_assets){
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, assets_spare());
   }
-  else if (var == "conf"){
-    if ((user_extra&2) == 2){return "Battery";}
-    else {return "Wired";}
+  else{
+    part = esp_ota_get_next_update_partition(NULL);
   }
-  else if (var == "serial"){
-    return serial_active ? "true" : "false";
+  if(part == NULL){
+    ota_result = "no partition";
+    return;
   }
-  else if (var == "reset"){
-    return force_restart_active ? "true" : "false";
+  if(ota_assets){http_assets_available(false);}
+  ota_region.select(part);
+  ota_begin(ota, &ota_region);
+  ota_result = "running";
+  if(serial_active){
+    Serial.print("OTA to ");
+    Serial.println(part->label);
   }
-  return String("N/A");
 }
 
-void html_template_processor(AsyncResponseStream *response, String html, TemplateProcessor callback){
-  bool keymode = false;
-  String keybuffer;
-  char placeholder = '~';
-  for(int i=0; i<html.length(); i++){
-    if(!keymode && html[i] != placeholder){
-      response->print(html[i]);
-    }
-    else if(!keymode && html[i] == placeholder){
-      keymode = true;
-      keybuffer = "";
-    }
-    else if(keymode && html[i] != placeholder){
-      keybuffer += html[i];
-    }
-    else if(keymode && html[i] == placeholder){
-      if(keybuffer.length() == 0){
-        response->print(placeholder);
-        continue;
+void ota_end(){
+  if(!ota_finish(ota, ota_hash)){
+    ota_result = ota_error_name(ota.error);
+  }
+  else if(ota_assets){
+    preferences.begin("ota");
+    preferences.putString("assets", ota_region.partition()->label);
+    preferences.end();
+    ota_status = 200;
+    ota_result = "assets updated, restarting";
+    ota_restart = millis();
+  }
+  else if(esp_ota_set_boot_partition(ota_region.partition()) != ESP_OK){
+    ota_result = "invalid firmware image";
+  }
+  else{
+    ota_boot_state boot;
+    ota_boot_updated(boot, esp_ota_get_running_partition()->label);
+    preferences.begin("ota");
+    preferences.putString("previous", boot.previous);
+    preferences.putUChar("tries", boot.tries);
+    preferences.end();
+    ota_status = 200;
+    ota_result = "firmware updated, restarting";
+    ota_restart = millis();
+  }
+  if(ota_assets && ota_status != 200){http_assets_available(true);}
+  if(serial_active){
+    Serial.print("OTA ");
+    Serial.print(ota_size(ota));
+    Serial.print(" bytes: ");
+    Serial.println(ota_result);
+  }
+}
+
+void ota_upload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final){
+  if(index == 0){
+    if(ota.active && ota_request != request){return;}
+    ota_request = request;
+    ota_start(request);
+    request->onDisconnect([request](){
+      if(ota_request == request && ota.active){
+        ota_abort(ota);
+        if(ota_assets){http_assets_available(true);}
       }
-      response->print(callback(keybuffer));
-      keymode = false;
-    }
+      if(ota_request == request){ota_request = NULL;}
+    });
   }
+  if(ota_request != request || !ota.active){return;}
+  if(!ota_write(ota, data, len) || final){ota_end();}
 }
 
-// spiffs functions--------------------------------------------------
+// stats functions---------------------------------------------------
+// counters since boot in RAM, totals in the "stats" partition (partitions.csv)
+
+void stats_setup(){
+  stats_init(stats, stats_track);
+  stats.boots = 1;
+  const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "stats");
+  if(part != NULL){
+    stats_region.select(part);
+    stats_persist = stats_log_open(stats_flash, &stats_region, stats_base);
+  }
+}
+
+stats_record stats_total(){
+  stats_record total = stats_base;
+  stats_merge(total, stats);
+  return total;
+}
 
-String readFile(fs::SPIFFSFS filesystem , String path){
-  String s_tmp = "";
-  File file = filesystem.open(path);
-  while(file.available()){
-    char tmp = file.read();
-    s_tmp += tmp;
+void stats_flush(){
+  stats_flushed = millis();
+  if(!stats_persist){return;}
+  if(!stats_log_append(stats_flash, stats_total())){
+    LOG(stats_failed);
   }
-  file.close();
-  return s_tmp;
+}
+
+void stats_update(){
+  unsigned long now = millis();
+  stats_time(stats, stats_track, user_mode, now - stats_tick);
+  stats_tick = now;
+  if(now - stats_flushed > stats_flush_interval){
+    stats_flush();
+  }
+}
+
+// log functions-----------------------------------------------------
+// LOG() only fills the ring of lib/Log, LogTask prints it when serial is
+// active. -DLOG_SERIAL_BINARY sends frames for tools/log_decode instead.
+
+uint32_t log_micros(){
+  return micros();
+}
+
+void log_send(const log_record &rec){
+#ifdef LOG_SERIAL_BINARY
+  uint8_t frame[LOG_FRAME_MAX];
+  Serial.write(frame, log_frame(rec, frame));
+#else
+  char line[128];
+  log_format(rec, line, sizeof(line));
+  Serial.println(line);
+#endif
+}
+
+void codeForLogTask(void * parameter){
+  log_record rec;
+  uint32_t dropped = 0;
+  LOG(start, LOG_VERSION, log_count);
+  for(;;){
+    while(log_read(log_main, rec)){
+      log_send(rec);
+    }
+    if(log_main.dropped != dropped){
+      LOG(dropped, log_main.dropped - dropped);
+      dropped = log_main.dropped;
+    }
+    delay(10);
+  }
+}
+
+void log_setup(){
+  log_init(log_micros);
+  log_level = LOG_DEBUG;
+  start_task_prio(codeForLogTask, "LogTask", NULL, log, LogTask, 0, 0);
 }
 
 // sleep functions---------------------------------------------------
@@ -359,89 +595,148 @@ void stop_sleep(){
   }
 }
 
+// heap functions----------------------------------------------------
+// STATIC_ALLOC: after setup() the mode tasks must not touch the heap.
+// WiFi, lwIP and the async server allocate in their own tasks and are
+// only counted. Linked with --wrap for malloc, calloc and realloc.
+
+#ifdef STATIC_ALLOC
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t n, size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+
+extern "C" void *__wrap_malloc(size_t size){
+  heap_guard_alloc(size);
+  return __real_malloc(size);
+}
+
+extern "C" void *__wrap_calloc(size_t n, size_t size){
+  heap_guard_alloc(n*size);
+  return __real_calloc(n, size);
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size){
+  heap_guard_alloc(size);
+  return __real_realloc(ptr, size);
+}
+
+bool heap_watched(){
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  for(int i=0; i<MODE_TASKS; i++){
+    if(task != NULL && task == modes.handle[i]){return true;}
+  }
+  return false;
+}
+
+void heap_violation(size_t size){
+  //no Serial here, it may allocate
+  ets_printf("heap use after boot: %u bytes in %s\n", (unsigned)size, pcTaskGetTaskName(NULL));
+  abort();
+}
+
+void heap_seal(){
+  heap_guard_seal(heap_watched, heap_violation);
+  if(serial_active){
+    Serial.println("heap sealed");
+  }
+}
+#endif
+
 // Code for Tasks ---------------------------------------------------
+// Mode tasks return at a point where they hold no lock once modes.stop is set.
+
 void codeForTouchTask( void * parameter ){
-  uint8_t runval[4] = {100, 100, 100, 100};
-  unsigned long starttime[4] = {0,0,0,0};
+  touch_pad pads[SWITCH_COUNT] = {};
+  trace_sample sample;
   for (;;) {
-    for (int i = 0; i < 4; i++) {
-      int val = touchRead(touch_pins[i]);
+    if(modes.stop){return;}
+    unsigned long now = millis();
+    for (int i = 0; i < SWITCH_COUNT; i++) {
+      int val = read_touch(i);
+      sample.touch[i] = val;
       if(val <= 5){
         continue;
       }
 
-      runval[i] = runval[i] * 0.8 + val * 0.2;
-      if(val < config[i][2]){
-        if(starttime[i] == 0){
-          starttime[i] = millis();
-        }
-          xSemaphoreTake(TouchLock, portMAX_DELAY);
-          touch_status[i] = 1+(uint16_t)((millis()- starttime[i])/1000);
-          xSemaphoreGive(TouchLock);
-      }
-      else{
-        xSemaphoreTake(TouchLock, portMAX_DELAY);
-        touch_status[i] = 0;
-        xSemaphoreGive(TouchLock);
-        starttime[i] = 0;
-      }
+      uint16_t status = touch_update(pads[i], touch_status[i], val, config[i][2], now);
+      xSemaphoreTake(TouchLock, portMAX_DELAY);
+      touch_status[i] = status;
+      xSemaphoreGive(TouchLock);
     }
+    sample.time = now;
+    sample.switches = get_switchmap();
+    xSemaphoreTake(TraceLock, portMAX_DELAY);
+    trace_record(trace, sample);
+    xSemaphoreGive(TraceLock);
     delay(5);
   }
 }
 
 void codeForBaseTask(void * parameter){
+  uint16_t touch[SWITCH_COUNT];
+  //switches already on at the mode start are no flips
+  switchmap_t last_switches = get_switchmap();
   for(;;){
-    uint8_t switches = get_switchmap();
-    if(switches == 0){
-      int pos = -1;
-      for(int i=0; i<4; i++){
-        if(is_touched(i)){
-          if(pos == -1){
-            pos = i;
-          }
-          else{
-            pos = -1;
-            break;
-          }
-        }
-      }
-      if(pos != -1){
-        uint16_t t_time = is_touched(pos);
-        if(t_time > 1){
-          stop_sleep();
-          rotate_to_switch(pos);
-          if(t_time > 2){
-            /* rotate_to_switch(pos); */
-            open_lid();
-            set_push(arm_move_push_max);
-          }
-        }
-      }
-      else{
+    if(modes.stop){return;}
+    switchmap_t switches = get_switchmap();
+    for(int i=0; i<SWITCH_COUNT; i++){
+      touch[i] = is_touched(i);
+    }
+    if(switches != last_switches){
+      stats_switches(stats, stats_track, last_switches, switches, millis());
+    }
+    predict_update(flips, last_switches, switches, millis());
+    last_switches = switches;
+
+    base_step step = base_decide(switches, touch, current_pos[0]);
+    step = predict_step(flips, step, current_pos[0], millis());
+    switch(step.action)
+    {
+      case BASE_PREPARE:
+        stop_sleep();
+        rotate_to_switch(step.target);
+        open_lid();
+        set_push(arm_move_push_max);
+        break;
+
+      case BASE_FOLLOW:
+        stop_sleep();
+        rotate_to_switch(step.target);
+        break;
+
+      case BASE_IDLE:
         start_sleep();
         retreat();
         close_lid();
-      }
-    }
-    else{
-      uint8_t next_target = 5;
-      for(int i=0; i<4; i++){
-        if(!is_touched(i) && is_pressed(i) && abs(current_pos[0]-i) < next_target){
-          next_target = i;
-        }
-      }
-      if(next_target < 5){
+        break;
+
+      case BASE_RESET:
+        stats_reset(stats_track, step.target);
         stop_sleep();
-        rotate_to_switch(next_target);
+        rotate_to_switch(step.target);
         open_lid();
         push_switch();
-      }
-      else{
+        break;
+
+      case BASE_DONE:
         retreat();
         close_lid();
         start_sleep();
-      }
+        break;
+
+      case BASE_PARK:
+        //move to the expected next switch while nobody waits for the arm
+        stop_sleep();
+        retreat();
+        close_lid();
+        rotate_to_switch(step.target);
+        start_sleep();
+        break;
+
+      case BASE_HOLD:
+        //next flip expected soon, keep lid open
+        delay(10);
+        break;
     }
   }
 }
@@ -456,7 +751,7 @@ void codeForConfigTask(void * parameter){
   if((user_extra&2) == 2){
     config_mode = 1;
   }
-  for(int i=0;i<4;i++){
+  for(int i=0;i<SWITCH_COUNT;i++){
     config[i][0] = config_default[config_mode][0];
     config[i][1] = config_default[config_mode][1];
     config[i][2] = config_default[config_mode][2];
@@ -464,23 +759,27 @@ void codeForConfigTask(void * parameter){
 
   delay(2000);
   uint8_t samplesize;
-  uint16_t summe[8] = {0,0,0,0,0,0,0,0};
+  uint16_t summe[2*SWITCH_COUNT] = {0};
   for(samplesize=1; samplesize < 250; samplesize++){
-    for(int i=0;i<4;i++){
+    if(modes.stop){return;}
+    for(int i=0;i<SWITCH_COUNT;i++){
       //get average value for no touch
-      int temp = touchRead(touch_pins[i]);
+      int temp = read_touch(i);
       if(temp > 10){
         //config[i][1] += temp;
-        summe[i+4] += temp;
+        summe[i+SWITCH_COUNT] += temp;
       }
       else{
         //config[i][1] += config[i][1]/samplesize;
-        summe[i+4] += summe[i+4]/samplesize;
+        summe[i+SWITCH_COUNT] += summe[i+SWITCH_COUNT]/samplesize;
       }
     }
     delay(50);
   }
-  for(int i=0;i<4;i++){
+  for(int i=0;i<SWITCH_COUNT;i++){
+    //switch without pad keeps the defaults
+    if(touch_pins[i] == TOUCH_NONE){continue;}
+    if(modes.stop){return;}
     //config[i][1] /= samplesize;
     rotate_to_switch(i);
     //ledcWrite(arm_push_id, calc_duty(arm_waiting, hz, bit_res));
@@ -489,23 +788,25 @@ void codeForConfigTask(void * parameter){
     //get average value for touched
     for(uint8_t t=1;t<250;t++){
       //config[i][0] += touchRead(touch_pins[i]);
-      summe[i] += touchRead(touch_pins[i]);
+      summe[i] += read_touch(i);
       delay(5);
     }
     config[i][0] = summe[i]/250;
-    config[i][1] = summe[i+4]/samplesize;
+    config[i][1] = summe[i+SWITCH_COUNT]/samplesize;
     config[i][2] = int(config[i][0]+(config[i][1]-config[i][0])*0.4);
     //ledcWrite(arm_push_id, calc_duty(arm_move_push_min, hz, bit_res));
     set_push(arm_move_push_min);
   }
 
-  //save to nvs
+  //save to nvs, allocates inside the nvs library
+  heap_guard_pause();
   save_config();
+  heap_guard_resume();
 
   if(serial_active){
     Serial.println("Results:");
     Serial.println("Pos | true | false | TH");
-    for(int i= 0; i<4; i++){
+    for(int i= 0; i<SWITCH_COUNT; i++){
       Serial.print(i);
       Serial.print("   | ");
       Serial.print(config[i][0]);
@@ -517,8 +818,12 @@ void codeForConfigTask(void * parameter){
   }
   ledcWrite(deckel_id, calc_duty(deckel_min, hz, bit_res));
   delay(1000);
-  if(!server_active){ESP.restart();}
-  for(;;){delay(1000);}
+  //back to the mode config was started from
+  mode_request = mode_after_config;
+  for(;;){
+    if(modes.stop){return;}
+    delay(100);
+  }
 }
 
 void codeForMoveTask(void * parameter){
@@ -532,6 +837,7 @@ void codeForMoveTask(void * parameter){
 
   uint16_t faktor;
   for(;;){
+    if(modes.stop){return;}
     faktor = is_touched(0);
     if(faktor > 1){faktor = 10;}
     if(faktor && rot-faktor > arm_move_rot_min){
@@ -576,23 +882,13 @@ void codeForMoveTask(void * parameter){
       //ledcWrite(arm_push_id, calc_duty(push, hz, bit_res));
       set_push(push);
       alt_push = push;
-      if(serial_active){      
-        Serial.print("push: ");
-        Serial.print(push);
-        Serial.print(" | rot: ");
-        Serial.println(rot);
-      }
+      LOG(move_pos, push, rot);
     }
     if(alt_rot != rot){
       //ledcWrite(arm_rot_id, calc_duty(rot, hz, bit_res));
       set_rot(rot);
       alt_rot = rot;
-      if(serial_active){ 
-        Serial.print("push: ");
-        Serial.print(push);
-        Serial.print(" | rot: ");
-        Serial.println(rot);
-      }
+      LOG(move_pos, push, rot);
     }
     delay(10);
   }
@@ -616,131 +912,75 @@ void server_setup(){
   dnsServer.setErrorReplyCode(DNSReplyCode::NoError);
   dnsServer.start(DNS_PORT, "*", WiFi.softAPIP());
 
-  SPIFFS.begin(false, "/spiffs", 20); // maxOpenFiles=20
-
-  switch_box = readFile(SPIFFS, "/switch_box.html");
-  info_box = readFile(SPIFFS,"/info_box.html");
-
-  // favicon
-  server.on("/favicon.ico", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/favicon.ico", "image/vnd.microsoft.icon");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-
-  // js
-  server.on("/jQuery.js", HTTP_GET, [](AsyncWebServerRequest *request){
-      AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/jQuery.js.gz", "text/javascript");
-      response->addHeader("Content-Encoding", "gzip");
-      response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-      request->send(response);
-    });
-
-  server.on("/main.js", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/main.js", "text/javascript");
-        response->addHeader("Cache-Control", "max-age=300, must-revalidate");
-        request->send(response);
-    });
-
-  // CSS
-  server.on("/main.css", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/main.css", "text/css");
-        response->addHeader("Cache-Control", "max-age=300, must-revalidate");
-        request->send(response);
-    });
-
-  server.on("/color_scheme.css", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/color_scheme.css", "text/css");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-
-  server.on("/fa-minimal.css", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-minimal.css", "text/css");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-
-  // Index
-  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/index.html", "text/html", false, html_info_processor);
-    });
+  assets_mount();
+  load_boxes();
 
-  server.on("/index.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/index.html", "text/html", false, html_info_processor);
-    });
+  // Pages, assets, status boxes and /move_data, see lib/Http/box_routes.cpp
+  box_routes_init(&box);
+  async_http_register(server, box_routes, box_route_count);
 
-    server.on("/sidenav.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/sidenav.html", "text/html");
-    });
-
-  server.on("/config_page.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/config_page.html", "text/html");
-    });
-
-  server.on("/move.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/move.html", "text/html");
-    });
-
-  // POSTS
-  server.on("/move_data", HTTP_GET, [](AsyncWebServerRequest *request){
-        int coords[2] = {0,0};
-        if(request->hasParam("x")){
-          coords[0] = (request->getParam("x")->value()).toInt();
+  // Mode
+  server.on("/mode", HTTP_GET, [](AsyncWebServerRequest *request){
+        int mode = request->hasParam("m") ? mode_from_name(request->getParam("m")->value().c_str()) : user_mode;
+        if(mode < 0){
+          request->send(400, "text/plain", "unknown mode");
+          return;
         }
-        if(request->hasParam("y")){
-          coords[1] = (request->getParam("y")->value()).toInt();
+        if(request->hasParam("conf")){
+          conf_request = request->getParam("conf")->value() == "battery" ? 1 : 0;
         }
-        Serial.print("x: "); Serial.print(coords[0]); Serial.print("| y: "); Serial.println(coords[1]);
-        request->send(200, "text/plain","done");
+        mode_request = mode;
+        request->send(200, "text/plain", "done");
     });
 
-  // Status Boxes
-  server.on("/info_box.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncResponseStream *response = request->beginResponseStream("text/html");
-        html_template_processor(response, info_box, html_info_processor);
-        request->send(response);
-    });
-  server.on("/switch_box.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncResponseStream *response = request->beginResponseStream("text/html");
-        html_template_processor(response, switch_box, html_switch_processor);
+  // Update
+  server.on("/update", HTTP_POST, [](AsyncWebServerRequest *request){
+        if(ota_request != request && ota.active){
+          request->send(409, "text/plain", "update already running");
+          return;
+        }
+        if(ota_request != request){
+          request->send(400, "text/plain", "missing image file");
+          return;
+        }
+        request->send(ota_status, "text/plain", ota_result);
+    }, ota_upload);
+
+  // Trace
+  server.on("/trace.bin", HTTP_GET, [](AsyncWebServerRequest *request){
+        //one block copy per lock, the touch task never waits for the stream
+        xSemaphoreTake(TraceLock, portMAX_DELAY);
+        size_t size = trace_dump_size(trace);
+        uint32_t first = trace_first_block(trace);
+        uint32_t end = trace.blocks;
+        xSemaphoreGive(TraceLock);
+        AsyncResponseStream *response = request->beginResponseStream("application/octet-stream", size);
+        response->addHeader("Content-Disposition", "attachment; filename=trace.bin");
+        uint8_t block[2 + TRACE_BLOCK_SIZE];
+        response->write(block, trace_dump_head(block));
+        for(uint32_t b=first; b<end; b++){
+          xSemaphoreTake(TraceLock, portMAX_DELAY);
+          size_t len = trace_dump_block(trace, b, block);
+          xSemaphoreGive(TraceLock);
+          response->write(block, len);
+        }
         request->send(response);
     });
-  server.on("/config_box.html", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(SPIFFS, "/config_box.html", "text/html", false, html_config_processor);
-    });
 
-  // Fonts
-  // fa-regular
-  server.on("/webfonts/fa-regular-400.ttf", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-regular-400.ttf", "font/ttf");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
+  // Stats
+  server.on("/stats.bin", HTTP_GET, [](AsyncWebServerRequest *request){
+        uint8_t data[STATS_SIZE];
+        stats_encode(stats_total(), data);
+        AsyncResponseStream *response = request->beginResponseStream("application/octet-stream", STATS_SIZE);
+        response->addHeader("Content-Disposition", "attachment; filename=stats.bin");
+        response->write(data, STATS_SIZE);
         request->send(response);
     });
-  server.on("/webfonts/fa-regular-400.woff", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-regular-400.woff", "font/woff");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-  server.on("/webfonts/fa-regular-400.woff2", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-regular-400.woff2", "font/woff2");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-  // fa-solid
-  server.on("/webfonts/fa-solid-900.ttf", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-solid-900.ttf", "font/ttf");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-  server.on("/webfonts/fa-solid-900.woff", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-solid-900.woff", "font/woff");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
-        request->send(response);
-    });
-  server.on("/webfonts/fa-solid-900.woff2", HTTP_GET, [](AsyncWebServerRequest *request){
-        AsyncWebServerResponse* response = request->beginResponse(SPIFFS, "/fa-solid-900.woff2", "font/woff2");
-        response->addHeader("Cache-Control", "max-age=3600, must-revalidate");
+  server.on("/stats.json", HTTP_GET, [](AsyncWebServerRequest *request){
+        AsyncResponseStream *response = request->beginResponseStream("application/json");
+        stats_json(stats_total(), [](const char *text, size_t len, void *ctx){
+          ((AsyncResponseStream*)ctx)->write((const uint8_t*)text, len);
+        }, response);
         request->send(response);
     });
 
@@ -764,19 +1004,146 @@ void serial_setup(){
   serial_active = true;
   delay(100);
   Serial.println("Serial active");
+  log_setup();
+}
+
+// mode functions----------------------------------------------------
+/*modes
+0: Touch
+8: No Touch
+4: Config
+2: Move
+6: Kiosk
+*/
+
+void (*const task_code[MODE_TASKS])(void*) = {codeForTouchTask, codeForBaseTask, codeForConfigTask, codeForMoveTask};
+
+#ifdef STATIC_ALLOC
+//created once: stopped tasks park instead of being deleted, their
+//StaticTask_t and stack stay in use until the next start wakes them
+TaskHandle_t created[MODE_TASKS];
+#endif
+
+void task_main(void *parameter){
+  uint8_t task = (uintptr_t)parameter;
+  for(;;){
+    task_code[task](NULL);
+    mode_task_done(modes, task);
+#ifdef STATIC_ALLOC
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+    vTaskDelete(NULL);
+#endif
+  }
+}
+
+void *task_start(uint8_t task){
+  TaskHandle_t handle = NULL;
+#ifdef STATIC_ALLOC
+  if(created[task] != NULL){
+    xTaskNotifyGive(created[task]);
+    return created[task];
+  }
+#endif
+  void *param = (void*)(uintptr_t)task;
+  switch(task)
+  {
+    case MODE_TOUCH:
+      start_task(task_main, "TouchTask", param, touch, handle, 0);
+      break;
+    case MODE_BASE:
+      start_task(task_main, "BaseTask", param, base, handle, 1);
+      break;
+    case MODE_CONFIG:
+      start_task(task_main, "ConfigTask", param, config, handle, 1);
+      break;
+    case MODE_MOVE:
+      start_task(task_main, "MoveTask", param, move, handle, 1);
+      break;
+  }
+#ifdef STATIC_ALLOC
+  created[task] = handle;
+#endif
+  return handle;
+}
+
+void task_wait(uint32_t ms){
+  delay(ms);
+}
+
+uint32_t task_millis(){
+  return millis();
+}
+
+//a task did not reach its stop check, starting the next mode next to
+//it would drive the servos twice
+void task_restart(uint8_t running){
+  LOG(mode_stuck, running);
+  if(serial_active){delay(100);} //LogTask prints the ring
+  stats_flush();
+  ESP.restart();
+}
+
+const mode_ops task_ops = {task_start, task_wait, task_millis, task_restart};
+
+void start_mode(uint8_t mode){
+  user_mode = mode;
+  force_restart_active = true;
+  if(mode == 6){reset_setup();}
+  if(serial_active){
+    Serial.print(mode_name(mode));
+    Serial.println(" mode");
+  }
+  mode_start(modes, mode);
+}
+
+void stop_mode(){
+  mode_stop(modes, mode_stop_timeout);
+  xSemaphoreTake(TouchLock, portMAX_DELAY);
+  for(int i=0; i<SWITCH_COUNT; i++){
+    touch_status[i] = 0;
+  }
+  xSemaphoreGive(TouchLock);
+  stop_sleep();
+  retreat();
+  close_lid(true);
+}
+
+void switch_mode(uint8_t mode, int conf){
+  unsigned long start = millis();
+  uint8_t old_mode = user_mode;
+  stop_mode();
+
+  if(conf == 1){user_extra |= 2;}
+  else if(conf == 0){user_extra &= ~2;}
+  load_config();
+
+  if(mode == 4 && old_mode != 4){mode_after_config = old_mode;}
+  start_mode(mode);
+
+  LOG(mode_switch, old_mode, mode, millis()-start, ESP.getFreeHeap());
+#ifdef STATIC_ALLOC
+  LOG(heap_allocs, heap_guard_count());
+#endif
 }
 
 void setup() {
+  ota_boot_check();
   //Serial setup
-  TouchLock = xSemaphoreCreateMutex();
+  TouchLock = create_lock(touch);
+  TraceLock = create_lock(trace);
+  mode_init(modes, &task_ops);
+  predict_init(flips);
+  trace_init(trace, TRACE_DEADBAND, TRACE_PERIOD);
+  stats_setup();
 
   //switch setup
   // uint8_t switchmap = 0;
-  for(int i=0; i<4; i++){
+  for(int i=0; i<SWITCH_COUNT; i++){
     pinMode(switch_pins[i], INPUT_PULLUP);
-    delay(100);
-    user_extra = user_extra | int(!digitalRead(switch_pins[i]))<<(3-i);
   }
+  delay(100);
+  user_extra = board_boot_bits(get_switchmap()); //first four switches
 
   //Servo setup
   ledcSetup(arm_rot_id, hz, bit_res);
@@ -810,56 +1177,21 @@ void setup() {
     2: Move
     6: Kiosk
     */
-    while(!digitalRead(switch_pins[3])){
+    while(is_pressed(3)){
       if(server_active){dnsServer.processNextRequest();}
       delay(100);
     }
-    user_mode = get_switchmap();
+    user_mode = board_boot_bits(get_switchmap());
   }
 
-  switch(user_mode)
-  {
-    case 6:
-      reset_setup();
-    
-    case 0:
-      if(serial_active){ 
-        Serial.println("Touch mode");
-      }
-      //Touch
-      xTaskCreatePinnedToCore(
-        codeForTouchTask, "TouchTask", 1000, NULL, 1, &TouchTask, 0);
-
-    case 8:
-      if(serial_active){ 
-        Serial.println("Base active");
-      }
-      //Base
-      xTaskCreatePinnedToCore(
-        codeForBaseTask, "BaseTask", 1000, NULL, 1, &BaseTask, 1);
-      break;
+  start_mode(user_mode);
 
-    case 4:
-      if(serial_active){ 
-        Serial.println("Config mode");
-      }
-      //Config
-      xTaskCreatePinnedToCore(
-        codeForConfigTask, "ConfigTask", 3000, NULL, 1, &ConfigTask, 1);
-      break;
+  //booted fine, cancel the rollback of a freshly updated firmware
+  ota_boot_valid();
 
-    case 2:
-      //Touch
-      xTaskCreatePinnedToCore(
-        codeForTouchTask, "TouchTask", 1000, NULL, 1, &TouchTask, 0);
-      //Arm controll
-      if(serial_active){ 
-        Serial.println("Move mode");
-      }
-      xTaskCreatePinnedToCore(
-        codeForMoveTask, "MoveTask", 1000, NULL, 1, &ConfigTask, 1);
-      break;
-  }
+#ifdef STATIC_ALLOC
+  heap_seal();
+#endif
 
   delay(500);
 }
@@ -869,8 +1201,39 @@ void loop() {
   //selfdestruct loop
   //vTaskDelete(NULL);
   if(server_active){dnsServer.processNextRequest();}
+  stats_update();
+  if(ota_restart && (millis()-ota_restart) > 1000){
+    stats_flush();
+    ESP.restart();
+  }
+  if(mode_request >= 0){
+    int mode = mode_request;
+    int conf = conf_request;
+    mode_request = -1;
+    conf_request = -1;
+    switch_mode(mode, conf);
+  }
   if(force_restart_active){
-    if(touchRead(touch_pins[0]) < config[0][2] && touchRead(touch_pins[1]) < config[1][2] && touchRead(touch_pins[2]) < config[2][2] && touchRead(touch_pins[3]) < config[3][2]){
+    bool pad[4];
+    for(int i=0; i<4; i++){
+      pad[i] = touchRead(touch_pins[i]) < config[i][2];
+    }
+    //outer pads for 3s: next mode (Touch -> No Touch -> Move), not in Move
+    //where they are the left and retreat controls
+    bool gesture_mode = user_mode == 0 || user_mode == 8;
+    if(gesture_mode && pad[0] && !pad[1] && !pad[2] && pad[3]){
+      if(mode_gesture == 0){
+        mode_gesture = millis();
+      }
+      else if((millis()-mode_gesture) > 3000){
+        mode_gesture = 0;
+        mode_request = user_mode == 0 ? 8 : user_mode == 8 ? 2 : 0;
+      }
+    }
+    else{
+      mode_gesture = 0;
+    }
+    if(pad[0] && pad[1] && pad[2] && pad[3]){
       if(force_restart == 0){
         force_restart = millis();
       }
@@ -879,6 +1242,7 @@ void loop() {
           Serial.println("force reboot");
           delay(10);
         }
+        stats_flush();
         ESP.restart();
       }
     }
@@ -0,0 +1,311 @@
+// Board descriptor, base decision and status box rows for the selected board
+//
+// pio test -e native -e native_box8 -e native_box16 -f test_board
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#include <board.h>
+#include <box_logic.h>
+#include <box_routes.h>
+
+// switch gpios from left to right, written out again from the wiring
+#if defined(BOARD_BOX16)
+static const uint8_t pins[] = {4, 5, 16, 17, 18, 19, 25, 26, 27, 14, 12, 13, 34, 35, 36, 39};
+#elif defined(BOARD_BOX8)
+static const uint8_t pins[] = {17, 16, 4, 18, 19, 5, 25, 26};
+#else
+static const uint8_t pins[] = {17, 16, 4, 18};
+#endif
+#define N (int)(sizeof(pins)/sizeof(pins[0]))
+
+// GPIO_IN_REG / GPIO_IN1_REG with all inputs high (released)
+static uint32_t in0;
+static uint32_t in1;
+
+static void press(uint8_t gpio){
+  if(gpio < 32){in0 &= ~(1u << gpio);}
+  else{in1 &= ~(1u << (gpio-32));}
+}
+
+// as get_switchmap() reads the registers
+static switchmap_t read_switchmap(){
+  return board_switchmap((uint64_t)in1 << 32 | in0);
+}
+
+// one bit per switch, switch 0 is the highest
+static switchmap_t bit(int i){
+  return 1 << (N-1-i);
+}
+
+void setUp(){
+  in0 = 0xffffffff;
+  in1 = 0x000000ff;
+}
+
+void tearDown(){}
+
+// board --------------------------------------------------------------
+
+void test_descriptor(){
+  TEST_ASSERT_EQUAL(N, SWITCH_COUNT);
+  for(int i=0; i<N; i++){
+    TEST_ASSERT_EQUAL(pins[i], board_switch_pins[i]);
+  }
+  for(int i=1; i<N; i++){
+    TEST_ASSERT_TRUE(board_switch_pos[i] > board_switch_pos[i-1]);
+  }
+}
+
+void test_switchmap_released(){
+  TEST_ASSERT_EQUAL_HEX16(0, read_switchmap());
+}
+
+void test_switchmap_single(){
+  for(int i=0; i<N; i++){
+    setUp();
+    press(pins[i]);
+    char msg[32];
+    snprintf(msg, sizeof(msg), "switch %d, gpio %d", i, pins[i]);
+    TEST_ASSERT_EQUAL_HEX16_MESSAGE(bit(i), read_switchmap(), msg);
+    TEST_ASSERT_TRUE_MESSAGE(switch_on(read_switchmap(), i), msg);
+  }
+}
+
+void test_switchmap_all(){
+  for(int i=0; i<N; i++){press(pins[i]);}
+  TEST_ASSERT_EQUAL_HEX16((1 << N) - 1, read_switchmap());
+}
+
+void test_switchmap_ignores_other_gpios(){
+  //everything low except the switches
+  in0 = 0;
+  in1 = 0;
+  for(int i=0; i<N; i++){
+    if(pins[i] < 32){in0 |= 1u << pins[i];}
+    else{in1 |= 1u << (pins[i]-32);}
+  }
+  TEST_ASSERT_EQUAL_HEX16(0, read_switchmap());
+}
+
+void test_switchmap_high_gpios(){
+  //GPIO 32-39 come from GPIO_IN1_REG
+  switchmap_t expect = 0;
+  for(int i=0; i<N; i++){
+    if(pins[i] >= 32){
+      press(pins[i]);
+      expect |= bit(i);
+    }
+  }
+#if defined(BOARD_BOX16)
+  TEST_ASSERT_EQUAL_HEX16(0x000f, expect);
+#endif
+  TEST_ASSERT_EQUAL_HEX16(expect, read_switchmap());
+  TEST_ASSERT_EQUAL_HEX32(0xffffffff, in0);
+}
+
+void test_gather(){
+  //board_gather takes the pressed bits active high
+  uint64_t pressed = 0;
+  for(int i=0; i<N; i += 2){pressed |= 1ULL << pins[i];}
+  switchmap_t expect = 0;
+  for(int i=0; i<N; i += 2){expect |= bit(i);}
+  TEST_ASSERT_EQUAL_HEX16(expect, board_gather<0>(pressed));
+  TEST_ASSERT_EQUAL_HEX16(0, board_gather<0>(~board_switch_mask));
+}
+
+void test_boot_bits(){
+  //the first four switches, switch 0 is the highest bit
+  static const uint8_t expect[4] = {8, 4, 2, 1};
+  for(int i=0; i<4; i++){
+    TEST_ASSERT_EQUAL(expect[i], board_boot_bits(bit(i)));
+  }
+  TEST_ASSERT_EQUAL(15, board_boot_bits((1 << N) - 1));
+  for(int i=4; i<N; i++){
+    TEST_ASSERT_EQUAL(0, board_boot_bits(bit(i)));
+  }
+  //mode select: Config is switch 1
+  setUp();
+  press(pins[1]);
+  TEST_ASSERT_EQUAL(4, board_boot_bits(read_switchmap()));
+}
+
+// base_decide -----------------------------------------------------------
+
+void test_base_idle(){
+  uint16_t touch[SWITCH_COUNT] = {0};
+  base_step step = base_decide(0, touch, 0);
+  TEST_ASSERT_EQUAL(BASE_IDLE, step.action);
+  //two pads: nobody to follow
+  touch[0] = 1;
+  touch[N-1] = 1;
+  TEST_ASSERT_EQUAL(BASE_IDLE, base_decide(0, touch, 0).action);
+}
+
+void test_base_touch(){
+  uint16_t touch[SWITCH_COUNT] = {0};
+  touch[N-1] = 1;
+  base_step step = base_decide(0, touch, 0);
+  TEST_ASSERT_EQUAL(BASE_WAIT, step.action);
+  TEST_ASSERT_EQUAL(N-1, step.target);
+  touch[N-1] = 1 + motion.follow_after;
+  TEST_ASSERT_EQUAL(BASE_FOLLOW, base_decide(0, touch, 0).action);
+  touch[N-1] = 1 + motion.prepare_after;
+  step = base_decide(0, touch, 0);
+  TEST_ASSERT_EQUAL(BASE_PREPARE, step.action);
+  TEST_ASSERT_EQUAL(N-1, step.target);
+}
+
+void test_base_reset_nearest(){
+  uint16_t touch[SWITCH_COUNT] = {0};
+  switchmap_t switches = bit(0) | bit(N-1);
+  base_step step = base_decide(switches, touch, N-2);
+  TEST_ASSERT_EQUAL(BASE_RESET, step.action);
+  TEST_ASSERT_EQUAL(N-1, step.target);
+  step = base_decide(switches, touch, 1);
+  TEST_ASSERT_EQUAL(0, step.target);
+  //a touched switch is guarded
+  touch[0] = 1;
+  step = base_decide(switches, touch, 1);
+  TEST_ASSERT_EQUAL(BASE_RESET, step.action);
+  TEST_ASSERT_EQUAL(N-1, step.target);
+  touch[N-1] = 1;
+  TEST_ASSERT_EQUAL(BASE_DONE, base_decide(switches, touch, 1).action);
+}
+
+// status box rows ------------------------------------------------------
+
+class string_response : public http_response {
+public:
+  void send(int status, const char *type, const char *body){
+    (void)type;
+    code = status;
+    out = body;
+  }
+  void send_file(const char *path, const char *type, const char *encoding, const char *cache){
+    (void)type; (void)encoding; (void)cache;
+    code = 200;
+    out = path;
+  }
+  void begin(const char *type){
+    (void)type;
+    code = 200;
+    out.clear();
+  }
+  void write(const char *data, size_t len){
+    out.append(data, len);
+  }
+  int code = 0;
+  std::string out;
+};
+
+class path_request : public http_request {
+public:
+  path_request(const char *path) : url(path) {}
+  const char *path(){return url;}
+  bool param(const char *name, char *out, size_t cap){
+    (void)name; (void)out; (void)cap;
+    return false;
+  }
+private:
+  const char *url;
+};
+
+static void snapshot(box_state &state, uint8_t parts){
+  (void)parts;
+  state.uptime = 3723000;
+  state.mode = "No Touch";
+  state.battery = true;
+  state.serial = false;
+  state.reset = true;
+  state.switches = bit(N-1);
+  for(int i=0; i<N; i++){
+    state.touch_status[i] = i == 0 ? 3 : 0;
+    state.touch_value[i] = i == 0 ? 8 : 30 + i;
+    state.config[i][0] = 8 + i;
+    state.config[i][1] = 30;
+    state.config[i][2] = 15;
+  }
+}
+
+static const char *box_template(const char *file, size_t *len){
+  const char *html = strcmp(file, "/info_box.html") == 0 ? "~uptime~|~mode~|~conf~|~serial~|~reset~|~x~" :
+                     strcmp(file, "/switch_box.html") == 0 ? "<table>~rows~</table>~switch0~ ~touch0~ ~tval1~" :
+                     "<table>~rows~</table>~cst1~ ~csf1~ ~csh1~ ~cst-1~";
+  *len = strlen(html);
+  return html;
+}
+
+static void move(int x, int y){
+  (void)x;
+  (void)y;
+}
+
+static const box_app app = {snapshot, box_template, move};
+
+static std::string render(const char *path){
+  box_routes_init(&app);
+  path_request req(path);
+  string_response res;
+  const http_route *route = http_find(box_routes, box_route_count, path);
+  TEST_ASSERT_NOT_NULL(route);
+  route->handler(req, res, *route);
+  TEST_ASSERT_EQUAL(200, res.code);
+  return res.out;
+}
+
+static int count(const std::string &text, const char *what){
+  int n = 0;
+  for(size_t pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos+1)){n++;}
+  return n;
+}
+
+void test_rows_switches(){
+  std::string html = render("/switch_box.html");
+  TEST_ASSERT_EQUAL(N, count(html, "<tr>"));
+  TEST_ASSERT_EQUAL(N, count(html, "</tr>"));
+  TEST_ASSERT_EQUAL(1, count(html, ">true<"));
+  TEST_ASSERT_TRUE(html.find("<table><tr><td>1</td><td class=\"bool_switch\">false</td>"
+                             "<td class=\"touch_switch\">3s</td><td class=\"blue\">8</td></tr>") == 0);
+  char last[128];
+  snprintf(last, sizeof(last), "<tr><td>%d</td><td class=\"bool_switch\">true</td>"
+           "<td class=\"touch_switch\">0s</td><td class=\"blue\">%d</td></tr></table>", N, 30+N-1);
+  TEST_ASSERT_TRUE_MESSAGE(html.find(last) != std::string::npos, last);
+  TEST_ASSERT_TRUE(html.find("</table>false 3s 31") != std::string::npos);
+}
+
+void test_rows_config(){
+  std::string html = render("/config_box.html");
+  TEST_ASSERT_EQUAL(N, count(html, "<tr>"));
+  char last[128];
+  snprintf(last, sizeof(last), "<tr><td>%d</td><td class=\"green\">%d</td>"
+           "<td class=\"red\">30</td><td class=\"blue\">15</td></tr></table>", N, 8+N-1);
+  TEST_ASSERT_TRUE_MESSAGE(html.find(last) != std::string::npos, last);
+  //negative index falls back to switch 0
+  TEST_ASSERT_TRUE(html.find("</table>9 30 15 8") != std::string::npos);
+}
+
+void test_info(){
+  TEST_ASSERT_EQUAL_STRING("01:02:03|No Touch|Battery|false|true|N/A", render("/info_box.html").c_str());
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_descriptor);
+  RUN_TEST(test_switchmap_released);
+  RUN_TEST(test_switchmap_single);
+  RUN_TEST(test_switchmap_all);
+  RUN_TEST(test_switchmap_ignores_other_gpios);
+  RUN_TEST(test_switchmap_high_gpios);
+  RUN_TEST(test_gather);
+  RUN_TEST(test_boot_bits);
+  RUN_TEST(test_base_idle);
+  RUN_TEST(test_base_touch);
+  RUN_TEST(test_base_reset_nearest);
+  RUN_TEST(test_rows_switches);
+  RUN_TEST(test_rows_config);
+  RUN_TEST(test_info);
+  return UNITY_END();
+}
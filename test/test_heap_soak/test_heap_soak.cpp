@@ -0,0 +1,424 @@
+// Soak test for the STATIC_ALLOC build: no heap use after boot
+//
+// pio test -e native -f test_heap_soak      (from the project dir, reads data/)
+//
+// Boots like setup() (templates into the box arena, trace, flip model),
+// seals the heap and then runs the touch and base task logic every 10 ms
+// of simulated time against a simulated user, with the web interface
+// polled like main.js does and a mode change every 10 minutes through
+// lib/Modes. malloc, calloc and realloc are hooked like the --wrap
+// functions in main.cpp, so operator new and the C library are seen too.
+// The hooks need glibc, elsewhere the test is ignored.
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <board.h>
+#include <box_logic.h>
+#include <predict.h>
+#include <trace.h>
+#include <modes.h>
+#include <box_routes.h>
+#include <http_slots.h>
+#include <heap_guard.h>
+
+#define soak_hours 2
+#define asset_dir "data"
+
+// allocation hooks ---------------------------------------------------
+
+#ifdef __GLIBC__
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+extern "C" void *malloc(size_t size){
+  heap_guard_alloc(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size){
+  heap_guard_alloc(n*size);
+  return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size){
+  heap_guard_alloc(size);
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr){
+  __libc_free(ptr);
+}
+#endif
+
+static bool injecting = false;
+
+static bool watch_all(){
+  return true;
+}
+
+static void report(size_t size){
+  //stderr is unbuffered, no allocation here
+  if(!injecting && heap_guard_violations() <= 10){
+    fprintf(stderr, "heap use after boot: %zu bytes\n", size);
+  }
+}
+
+// simulated box ------------------------------------------------------
+
+#define box_arena_size 4096
+static char box_arena[box_arena_size];
+
+struct box_file {
+  const char *path;
+  const char *html;
+  size_t len;
+};
+static box_file box_files[] = {{"/info_box.html", "", 0}, {"/switch_box.html", "", 0}, {"/config_box.html", "", 0}};
+
+static unsigned long now = 0;
+static uint8_t mode = 0;
+static switchmap_t switches = 0;
+static uint16_t touch_val[SWITCH_COUNT];
+static uint16_t touch_status[SWITCH_COUNT];
+static touch_pad pads[SWITCH_COUNT];
+static uint8_t config[SWITCH_COUNT][3];
+static int rot_pos = 0;
+static flip_model flips;
+static trace_buffer trace;
+
+static uint32_t rng = 1;
+static uint32_t random_next(uint32_t n){
+  rng = rng * 1103515245 + 12345;
+  return (rng >> 8) % n;
+}
+
+static bool load_boxes(const char *dir){
+  size_t used = 0;
+  for(int i=0; i<3; i++){
+    char path[256];
+    snprintf(path, sizeof(path), "%s%s", dir, box_files[i].path);
+    box_files[i].html = box_arena + used;
+    FILE *f = fopen(path, "rb");
+    if(!f){return false;}
+    box_files[i].len = fread(box_arena + used, 1, box_arena_size - used, f);
+    fclose(f);
+    used += box_files[i].len;
+  }
+  return true;
+}
+
+static const char *box_template(const char *file, size_t *len){
+  for(int i=0; i<3; i++){
+    if(strcmp(file, box_files[i].path) == 0){
+      *len = box_files[i].len;
+      return box_files[i].html;
+    }
+  }
+  *len = 0;
+  return "";
+}
+
+static void snapshot(box_state &state, uint8_t parts){
+  if(parts & BOX_INFO){
+    state.uptime = now;
+    state.mode = mode_name(mode);
+    state.battery = false;
+    state.serial = false;
+    state.reset = true;
+  }
+  if(parts & BOX_SWITCHES){
+    state.switches = switches;
+    memcpy(state.touch_status, touch_status, sizeof(state.touch_status));
+    memcpy(state.touch_value, touch_val, sizeof(state.touch_value));
+  }
+  if(parts & BOX_CONFIG){
+    for(int i=0; i<SWITCH_COUNT; i++){
+      for(int k=0; k<3; k++){state.config[i][k] = config[i][k];}
+    }
+  }
+}
+
+static void move(int x, int y){
+  rot_pos = (x + y) % SWITCH_COUNT;
+}
+
+static const box_app app = {snapshot, box_template, move};
+
+// web interface -------------------------------------------------------
+
+class soak_request : public http_request {
+public:
+  soak_request(const char *target){
+    snprintf(url, sizeof(url), "%s", target);
+    query = strchr(url, '?');
+    if(query){*query++ = 0;}
+  }
+
+  const char *path(){return url;}
+
+  bool param(const char *name, char *out, size_t cap){
+    size_t len = strlen(name);
+    for(const char *p = query; p && *p; p = strchr(p, '&') ? strchr(p, '&')+1 : NULL){
+      if(strncmp(p, name, len) == 0 && p[len] == '='){
+        size_t n = strcspn(p+len+1, "&");
+        if(n >= cap){n = cap-1;}
+        memcpy(out, p+len+1, n);
+        out[n] = 0;
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  char url[64];
+  char *query;
+};
+
+// Renders into an http_slot like async_response does with STATIC_ALLOC
+class soak_response : public http_response {
+public:
+  soak_response() : slot(NULL), status(0) {}
+  ~soak_response(){
+    if(slot){http_slot_give(slot);}
+  }
+
+  void send(int code, const char *type, const char *body){
+    (void)type;
+    status = code;
+    if(take()){http_slot_write(slot, body, strlen(body));}
+  }
+
+  void send_file(const char *path, const char *type, const char *encoding, const char *cache){
+    (void)path; (void)type; (void)encoding; (void)cache;
+    status = 200;
+  }
+
+  void begin(const char *type){
+    (void)type;
+    status = 200;
+    take();
+  }
+
+  void write(const char *data, size_t len){
+    if(slot){http_slot_write(slot, data, len);}
+  }
+
+  http_slot *slot;
+  int status;
+
+private:
+  bool take(){
+    slot = http_slot_take();
+    if(slot == NULL){status = 503;}
+    return slot != NULL;
+  }
+};
+
+static unsigned long requests = 0;
+static unsigned long failed = 0;
+static unsigned long long bytes = 0;
+
+static void get(const char *target){
+  soak_request req(target);
+  soak_response res;
+  const http_route *route = http_find(box_routes, box_route_count, req.path());
+  requests++;
+  if(route == NULL){
+    failed++;
+    return;
+  }
+  route->handler(req, res, *route);
+  if(res.status != 200 || (res.slot && res.slot->overflow)){
+    failed++;
+    return;
+  }
+  if(res.slot){bytes += res.slot->len;}
+}
+
+// tasks -------------------------------------------------------------
+
+static unsigned long user_next = 0;     // next user action
+static int user_pad = -1;              // pad the user hovers over
+static unsigned long user_until = 0;
+static int push_target = -1;           // switch the arm is pushing back
+static unsigned long push_done = 0;
+static switchmap_t last_switches = 0;
+static unsigned long mode_changes = 0;
+
+static void user_step(){
+  if(user_pad >= 0 && now >= user_until){user_pad = -1;}
+  if(now < user_next){return;}
+  int i = random_next(SWITCH_COUNT);
+  if(random_next(4) == 0){
+    user_pad = i;
+    user_until = now + 500 + random_next(3000);
+  }
+  else{
+    switches |= 1 << (SWITCH_COUNT-1-i);
+  }
+  user_next = now + 500 + random_next(20000);
+}
+
+static void touch_task(){
+  trace_sample sample;
+  for(int i=0; i<SWITCH_COUNT; i++){
+    touch_val[i] = (i == user_pad ? 8 : 30) + random_next(3);
+    sample.touch[i] = touch_val[i];
+    touch_status[i] = touch_update(pads[i], touch_status[i], touch_val[i], config[i][2], now);
+  }
+  sample.time = now;
+  sample.switches = switches;
+  trace_record(trace, sample);
+}
+
+static void base_task(){
+  if(push_target >= 0){
+    if(now >= push_done){
+      switches &= ~(1 << (SWITCH_COUNT-1-push_target));
+      push_target = -1;
+    }
+    return;
+  }
+  predict_update(flips, last_switches, switches, now);
+  last_switches = switches;
+  base_step step = base_decide(switches, touch_status, rot_pos);
+  step = predict_step(flips, step, rot_pos, now);
+  switch(step.action)
+  {
+    case BASE_RESET:
+      push_target = step.target;
+      push_done = now + 300 + 150*abs(rot_pos - step.target);
+      rot_pos = step.target;
+      break;
+    case BASE_FOLLOW:
+    case BASE_PREPARE:
+    case BASE_PARK:
+      rot_pos = step.target;
+      break;
+  }
+}
+
+// lib/Modes with the tasks stepped by the soak loop ---------------------
+
+static mode_runner modes;
+static int soak_task[MODE_TASKS];
+static unsigned long restarts = 0;
+
+static void *soak_start(uint8_t task){
+  if(task == MODE_BASE){last_switches = switches;}
+  return &soak_task[task];
+}
+
+static void soak_wait(uint32_t ms){
+  //every task reaches its stop check within one 10 ms tick
+  now += ms;
+  for(int i=0; i<MODE_TASKS; i++){
+    if(modes.stop && modes.handle[i] != NULL){mode_task_done(modes, i);}
+  }
+}
+
+static uint32_t soak_millis(){
+  return now;
+}
+
+static void soak_restart(uint8_t running){
+  (void)running;
+  restarts++;
+}
+
+static const mode_ops soak_ops = {soak_start, soak_wait, soak_millis, soak_restart};
+
+static void switch_mode(uint8_t next){
+  //stop_mode(): pads and status start over, flip model and trace stay
+  mode_stop(modes, 5000);
+  memset(pads, 0, sizeof(pads));
+  memset(touch_status, 0, sizeof(touch_status));
+  push_target = -1;
+  mode = next;
+  mode_start(modes, mode);
+  mode_changes++;
+}
+
+void setUp(){}
+
+void tearDown(){}
+
+void test_no_heap_after_boot(){
+#ifndef __GLIBC__
+  TEST_IGNORE_MESSAGE("malloc hooks need glibc");
+#endif
+  //setup()
+  TEST_ASSERT_TRUE_MESSAGE(load_boxes(asset_dir), "box templates missing, run from the project dir");
+  box_routes_init(&app);
+  predict_init(flips);
+  trace_init(trace, TRACE_DEADBAND, TRACE_PERIOD);
+  for(int i=0; i<SWITCH_COUNT; i++){
+    config[i][0] = 8;
+    config[i][1] = 30;
+    config[i][2] = 15;
+  }
+  mode_init(modes, &soak_ops);
+  mode_start(modes, mode);
+  heap_guard_seal(watch_all, report);
+
+  static const uint8_t mode_cycle[] = {0, 8, 2, 0, 4};
+  const unsigned long end = soak_hours * 3600ul * 1000;
+  unsigned long samples = 0;
+  for(now = 0; now < end; now += 10){
+    user_step();
+    if(modes.handle[MODE_TOUCH]){
+      touch_task();
+      samples++;
+    }
+    if(modes.handle[MODE_BASE]){base_task();}
+
+    //main.js: info box, 20 ms later the switch box, every second
+    if(now % 1000 == 0){get("/info_box.html");}
+    if(now % 1000 == 20){get("/switch_box.html");}
+    if(now % 10000 == 500){get("/config_box.html");}
+    if(now % 60000 == 700){get("/index.html");}
+    if(modes.handle[MODE_MOVE] && now % 100 == 50){
+      char target[48];
+      snprintf(target, sizeof(target), "/move_data?x=%d&y=%d", (int)random_next(200), (int)random_next(200));
+      get(target);
+    }
+    if(now % 600000 == 0 && now > 0){
+      switch_mode(mode_cycle[(now / 600000) % sizeof(mode_cycle)]);
+    }
+  }
+  unsigned long allocations = heap_guard_count();
+
+  //an allocation after the seal is seen by the hooks
+  static void *volatile injected;
+  injecting = true;
+  injected = malloc(16);
+  injected = realloc(injected, 32);
+  free(injected);
+  unsigned long caught = heap_guard_count() - allocations;
+  //Unity's output is not part of the box
+  heap_guard_pause();
+
+  char msg[160];
+  snprintf(msg, sizeof(msg), "%d h, %d switches: %lu requests (%lu failed), %llu bytes, %lu touch samples, "
+           "%lu mode changes, %lu allocations",
+           soak_hours, SWITCH_COUNT, requests, failed, bytes, samples, mode_changes, allocations);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_MESSAGE(0, allocations, msg);
+  TEST_ASSERT_EQUAL(0, failed);
+  TEST_ASSERT_EQUAL(0, restarts);
+  TEST_ASSERT_EQUAL(soak_hours * 6 - 1, mode_changes);
+  TEST_ASSERT_TRUE(samples > 0 && flips.flips > 0);
+  TEST_ASSERT_EQUAL(2, caught);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_no_heap_after_boot);
+  return UNITY_END();
+}
@@ -0,0 +1,226 @@
+// Task bookkeeping of lib/Modes with fake tasks on a simulated clock
+//
+// pio test -e native -f test_modes
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <modes.h>
+
+#define mode_poll 10        // mode_stop() polling [ms]
+#define never 0xffffffff
+
+static mode_runner runner;
+static uint32_t now;
+static uint32_t stop_since;
+static uint32_t exit_after[MODE_TASKS];   // from mode_stop() to the fake task's exit [ms]
+static uint32_t last_exit;
+static int restarts;
+static uint8_t restart_running;
+static int fake_task[MODE_TASKS];
+
+static void *fake_start(uint8_t task){
+  return &fake_task[task];
+}
+
+static void fake_wait(uint32_t ms){
+  if(runner.stop && stop_since == never){stop_since = now;}
+  for(uint32_t t=0; t<ms; t++){
+    now++;
+    for(int i=0; i<MODE_TASKS; i++){
+      if(runner.handle[i] != NULL && runner.stop && exit_after[i] != never && now - stop_since >= exit_after[i]){
+        mode_task_done(runner, i);
+        last_exit = now;
+      }
+    }
+  }
+}
+
+static uint32_t fake_millis(){
+  return now;
+}
+
+static void fake_restart(uint8_t running){
+  restarts++;
+  restart_running = running;
+}
+
+static const mode_ops fake_ops = {fake_start, fake_wait, fake_millis, fake_restart};
+
+static void set_exits(uint32_t touch, uint32_t base, uint32_t config, uint32_t move){
+  exit_after[MODE_TOUCH] = touch;
+  exit_after[MODE_BASE] = base;
+  exit_after[MODE_CONFIG] = config;
+  exit_after[MODE_MOVE] = move;
+}
+
+static bool stop(uint32_t timeout){
+  stop_since = never;
+  return mode_stop(runner, timeout);
+}
+
+static uint32_t total_starts(){
+  uint32_t starts = 0;
+  for(int i=0; i<MODE_TASKS; i++){starts += runner.starts[i];}
+  return starts;
+}
+
+void setUp(){
+  mode_init(runner, &fake_ops);
+  now = 1000;
+  last_exit = 0;
+  restarts = 0;
+  restart_running = 0;
+  //touch and move loop every few ms, base waits for a push poll,
+  //config for its pad loop
+  set_exits(5, 100, 3250, 10);
+}
+
+void tearDown(){}
+
+void test_names(){
+  static const uint8_t modes[] = {0, 8, 4, 2, 6};
+  static const char *names[] = {"touch", "notouch", "config", "move", "kiosk"};
+  for(int i=0; i<5; i++){
+    TEST_ASSERT_EQUAL(modes[i], mode_from_name(names[i]));
+  }
+  TEST_ASSERT_EQUAL(-1, mode_from_name("Touch"));
+  TEST_ASSERT_EQUAL_STRING("No Touch", mode_name(8));
+  TEST_ASSERT_EQUAL_STRING("None", mode_name(1));
+  TEST_ASSERT_EQUAL(0, mode_tasks(1));
+}
+
+void test_tasks_per_mode(){
+  TEST_ASSERT_EQUAL(1<<MODE_TOUCH | 1<<MODE_BASE, mode_tasks(0));
+  TEST_ASSERT_EQUAL(1<<MODE_BASE, mode_tasks(8));
+  TEST_ASSERT_EQUAL(1<<MODE_CONFIG, mode_tasks(4));
+  TEST_ASSERT_EQUAL(1<<MODE_TOUCH | 1<<MODE_MOVE, mode_tasks(2));
+  TEST_ASSERT_EQUAL(1<<MODE_TOUCH | 1<<MODE_BASE, mode_tasks(6));
+}
+
+void test_transitions(){
+  //every switch stops all tasks of the old mode and starts all of the new one
+  struct {
+    uint8_t from, to;
+    int stopped, started;
+  } table[] = {
+    {0, 8, 2, 1},     // Touch -> No Touch (mode gesture)
+    {8, 2, 1, 2},     // No Touch -> Move
+    {2, 0, 2, 2},     // Move -> Touch
+    {0, 4, 2, 1},     // Touch -> Config
+    {4, 0, 1, 2},     // Config -> Touch (after calibration)
+    {0, 6, 2, 2},     // Touch -> Kiosk
+    {4, 4, 1, 1},
+  };
+  for(size_t i=0; i<sizeof(table)/sizeof(table[0]); i++){
+    char msg[48];
+    snprintf(msg, sizeof(msg), "%s -> %s", mode_name(table[i].from), mode_name(table[i].to));
+    mode_start(runner, table[i].from);
+    TEST_ASSERT_EQUAL_MESSAGE(table[i].stopped, __builtin_popcount(mode_running(runner)), msg);
+    TEST_ASSERT_TRUE_MESSAGE(stop(5000), msg);
+    TEST_ASSERT_EQUAL_MESSAGE(0, mode_running(runner), msg);
+    uint32_t starts = total_starts();
+    mode_start(runner, table[i].to);
+    TEST_ASSERT_FALSE_MESSAGE(runner.stop, msg);
+    TEST_ASSERT_EQUAL_MESSAGE(mode_tasks(table[i].to), mode_running(runner), msg);
+    TEST_ASSERT_EQUAL_MESSAGE(table[i].started, total_starts() - starts, msg);
+    TEST_ASSERT_TRUE_MESSAGE(stop(5000), msg);
+  }
+  TEST_ASSERT_EQUAL(0, restarts);
+}
+
+void test_stop_waits_for_last_exit(){
+  //mode_stop returns within one poll of the slowest task's exit, never before
+  static const uint8_t modes[] = {0, 8, 4, 2};
+  const uint32_t exits[][MODE_TASKS] = {{5, 100, 3250, 10}, {37, 1, 1, 499}, {1, 1, 4990, 1}};
+  for(size_t e=0; e<sizeof(exits)/sizeof(exits[0]); e++){
+    set_exits(exits[e][0], exits[e][1], exits[e][2], exits[e][3]);
+    for(size_t m=0; m<sizeof(modes); m++){
+      mode_start(runner, modes[m]);
+      uint32_t start = now;
+      TEST_ASSERT_TRUE(stop(5000));
+      uint32_t slowest = 0;
+      for(int i=0; i<MODE_TASKS; i++){
+        if(mode_tasks(modes[m]) & 1<<i && exit_after[i] > slowest){slowest = exit_after[i];}
+      }
+      TEST_ASSERT_EQUAL_UINT32(start + slowest, last_exit);
+      TEST_ASSERT_GREATER_OR_EQUAL(last_exit, now);
+      TEST_ASSERT_LESS_THAN(last_exit + mode_poll, now);
+    }
+  }
+  //nothing running: no wait at all
+  uint32_t start = now;
+  TEST_ASSERT_TRUE(stop(5000));
+  TEST_ASSERT_EQUAL_UINT32(start, now);
+  TEST_ASSERT_EQUAL(0, restarts);
+}
+
+void test_balanced(){
+  //every start is matched by an exit, no handle is left behind
+  static const uint8_t cycle[] = {0, 8, 2, 0, 4, 0, 6, 0, 8, 4, 2};
+  for(int round=0; round<20; round++){
+    for(size_t i=0; i<sizeof(cycle); i++){
+      mode_start(runner, cycle[i]);
+      TEST_ASSERT_TRUE(stop(5000));
+      TEST_ASSERT_EQUAL(0, mode_running(runner));
+    }
+  }
+  for(int i=0; i<MODE_TASKS; i++){
+    TEST_ASSERT_NULL(runner.handle[i]);
+    TEST_ASSERT_EQUAL_UINT32(runner.starts[i], runner.exits[i]);
+  }
+  TEST_ASSERT_EQUAL(20*2, runner.starts[MODE_CONFIG]);
+}
+
+void test_stuck_task_restarts(){
+  //base task in push_switch() on a switch that never goes off
+  set_exits(5, never, 3250, 10);
+  mode_start(runner, 0);
+  uint32_t start = now;
+  TEST_ASSERT_FALSE(stop(5000));
+  TEST_ASSERT_GREATER_OR_EQUAL(start + 5000, now);
+  TEST_ASSERT_LESS_THAN(start + 5000 + mode_poll, now);
+  TEST_ASSERT_EQUAL(1, restarts);
+  TEST_ASSERT_EQUAL(1<<MODE_BASE, restart_running);
+  TEST_ASSERT_EQUAL(1<<MODE_BASE, mode_running(runner));
+  TEST_ASSERT_NULL(runner.handle[MODE_TOUCH]);
+
+  //if the restart returns, a running task is not started a second time
+  mode_start(runner, 8);
+  TEST_ASSERT_EQUAL(1, runner.starts[MODE_BASE]);
+}
+
+void test_slow_task_no_restart(){
+  //a task that exits in the last poll before the timeout
+  set_exits(5, 4995, 3250, 10);
+  mode_start(runner, 0);
+  TEST_ASSERT_TRUE(stop(5000));
+  TEST_ASSERT_EQUAL(0, restarts);
+  TEST_ASSERT_EQUAL(0, mode_running(runner));
+}
+
+void test_failed_start(){
+  static const mode_ops failing = {
+    [](uint8_t task) -> void* {(void)task; return NULL;}, fake_wait, fake_millis, fake_restart
+  };
+  mode_init(runner, &failing);
+  mode_start(runner, 0);
+  TEST_ASSERT_EQUAL(0, mode_running(runner));
+  TEST_ASSERT_EQUAL(0, runner.starts[MODE_TOUCH]);
+  TEST_ASSERT_TRUE(stop(5000));
+  TEST_ASSERT_EQUAL(0, restarts);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_names);
+  RUN_TEST(test_tasks_per_mode);
+  RUN_TEST(test_transitions);
+  RUN_TEST(test_stop_waits_for_last_exit);
+  RUN_TEST(test_balanced);
+  RUN_TEST(test_stuck_task_restarts);
+  RUN_TEST(test_slow_task_no_restart);
+  RUN_TEST(test_failed_start);
+  return UNITY_END();
+}
@@ -0,0 +1,200 @@
+// lib/Ota against a file-backed flash partition (tools/file_region.h):
+// streamed writes, hash checks and the software rollback
+//
+// pio test -e native -f test_ota
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <ota.h>
+
+#include "../../tools/file_region.h"
+
+#define part_size (64*1024)
+
+static FILE *running_file;
+static FILE *update_file;
+static file_region *running;   // app0 with the firmware that is booted
+static file_region *update;    // app1 taking the update
+static ota_writer ota;
+
+static uint32_t rng_state = 1;
+static uint32_t rng(){
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static std::vector<uint8_t> image(size_t size){
+  std::vector<uint8_t> data(size);
+  for(size_t i=0; i<size; i++){data[i] = rng();}
+  return data;
+}
+
+static void hash(const std::vector<uint8_t> &data, uint8_t out[SHA256_SIZE]){
+  sha256_ctx ctx;
+  sha256_init(ctx);
+  sha256_update(ctx, data.data(), data.size());
+  sha256_final(ctx, out);
+}
+
+static std::vector<uint8_t> contents(file_region *region, size_t size){
+  std::vector<uint8_t> data(size);
+  TEST_ASSERT_TRUE(region->read(0, data.data(), size));
+  return data;
+}
+
+// POST /update hands the image over in TCP sized pieces
+static bool stream(const std::vector<uint8_t> &data, size_t piece){
+  ota_begin(ota, update);
+  for(size_t pos=0; pos<data.size(); pos+=piece){
+    size_t n = data.size() - pos < piece ? data.size() - pos : piece;
+    if(!ota_write(ota, data.data()+pos, n)){return false;}
+  }
+  return true;
+}
+
+void setUp(){
+  rng_state = 1;
+  //used flash: random garbage in both partitions
+  running_file = tmpfile();
+  update_file = tmpfile();
+  std::vector<uint8_t> garbage = image(part_size);
+  fwrite(garbage.data(), 1, part_size, running_file);
+  fwrite(garbage.data(), 1, part_size, update_file);
+  running = new file_region(running_file, part_size);
+  update = new file_region(update_file, part_size);
+}
+
+void tearDown(){
+  delete running;
+  delete update;
+  fclose(running_file);
+  fclose(update_file);
+}
+
+void test_write_verify(){
+  std::vector<uint8_t> data = image(20000);
+  uint8_t expected[SHA256_SIZE];
+  hash(data, expected);
+  TEST_ASSERT_TRUE(stream(data, 1436));
+  TEST_ASSERT_EQUAL(20000, ota_size(ota));
+  TEST_ASSERT_TRUE(ota_finish(ota, expected));
+  TEST_ASSERT_EQUAL(OTA_OK, ota.error);
+  TEST_ASSERT_FALSE(ota.active);
+  TEST_ASSERT_TRUE(contents(update, data.size()) == data);
+  //only the sectors the image needs are erased
+  TEST_ASSERT_EQUAL(5, update->erases);
+}
+
+void test_piece_sizes(){
+  std::vector<uint8_t> data = image(3*OTA_CHUNK + 17);
+  uint8_t expected[SHA256_SIZE];
+  hash(data, expected);
+  const size_t pieces[] = {1, 7, OTA_CHUNK, OTA_CHUNK+1, data.size()};
+  for(size_t i=0; i<sizeof(pieces)/sizeof(pieces[0]); i++){
+    TEST_ASSERT_TRUE(stream(data, pieces[i]));
+    TEST_ASSERT_TRUE(ota_finish(ota, expected));
+    TEST_ASSERT_TRUE(contents(update, data.size()) == data);
+  }
+}
+
+void test_sha_mismatch(){
+  //the running firmware stays untouched and nothing gets selected
+  std::vector<uint8_t> old_running = contents(running, part_size);
+  std::vector<uint8_t> data = image(10000);
+  uint8_t expected[SHA256_SIZE];
+  hash(data, expected);
+  expected[0] ^= 1;
+  TEST_ASSERT_TRUE(stream(data, 1436));
+  TEST_ASSERT_FALSE(ota_finish(ota, expected));
+  TEST_ASSERT_EQUAL(OTA_ERR_HASH, ota.error);
+  TEST_ASSERT_EQUAL_STRING("sha256 mismatch", ota_error_name(ota.error));
+  TEST_ASSERT_FALSE(ota.active);
+  TEST_ASSERT_TRUE(contents(running, part_size) == old_running);
+  //further pieces of the same upload are refused
+  TEST_ASSERT_FALSE(ota_write(ota, data.data(), 1));
+  TEST_ASSERT_EQUAL(OTA_ERR_HASH, ota.error);
+}
+
+void test_verify_failure(){
+  //a stuck bit: the streamed hash matches, the read back does not
+  std::vector<uint8_t> data = image(5000);
+  data[100] = 0xff;
+  uint8_t expected[SHA256_SIZE];
+  hash(data, expected);
+  ota_begin(ota, update);
+  TEST_ASSERT_TRUE(ota_write(ota, data.data(), OTA_CHUNK));
+  uint8_t zero = 0;
+  TEST_ASSERT_TRUE(update->write(100, &zero, 1));
+  TEST_ASSERT_TRUE(ota_write(ota, data.data()+OTA_CHUNK, data.size()-OTA_CHUNK));
+  TEST_ASSERT_FALSE(ota_finish(ota, expected));
+  TEST_ASSERT_EQUAL(OTA_ERR_VERIFY, ota.error);
+}
+
+void test_too_large(){
+  //the byte past the partition stays in the chunk until ota_finish
+  std::vector<uint8_t> data = image(part_size + 1);
+  uint8_t expected[SHA256_SIZE];
+  hash(data, expected);
+  TEST_ASSERT_TRUE(stream(data, 4096));
+  TEST_ASSERT_FALSE(ota_finish(ota, expected));
+  TEST_ASSERT_EQUAL(OTA_ERR_SIZE, ota.error);
+  TEST_ASSERT_FALSE(ota.active);
+  data.resize(part_size + OTA_CHUNK);
+  TEST_ASSERT_FALSE(stream(data, 4096));
+  TEST_ASSERT_EQUAL(OTA_ERR_SIZE, ota.error);
+}
+
+void test_state(){
+  uint8_t expected[SHA256_SIZE] = {0};
+  ota_begin(ota, update);
+  ota_abort(ota);
+  TEST_ASSERT_FALSE(ota_write(ota, expected, 1));
+  TEST_ASSERT_EQUAL(OTA_ERR_STATE, ota.error);
+  TEST_ASSERT_FALSE(ota_finish(ota, expected));
+}
+
+void test_rollback(){
+  //a new firmware that never confirms falls back after OTA_BOOT_TRIES boots
+  ota_boot_state boot = {"", 0};
+  TEST_ASSERT_FALSE(ota_boot_failed(boot));
+  TEST_ASSERT_EQUAL(0, boot.tries);
+  ota_boot_updated(boot, "app0");
+  for(int i=0; i<OTA_BOOT_TRIES; i++){
+    TEST_ASSERT_FALSE(ota_boot_failed(boot));
+  }
+  TEST_ASSERT_TRUE(ota_boot_failed(boot));
+  TEST_ASSERT_EQUAL_STRING("app0", boot.previous);
+}
+
+void test_rollback_confirm(){
+  //a confirmed firmware keeps booting
+  ota_boot_state boot = {"", 0};
+  ota_boot_updated(boot, "app1");
+  TEST_ASSERT_FALSE(ota_boot_failed(boot));
+  ota_boot_confirm(boot);
+  for(int i=0; i<2*OTA_BOOT_TRIES; i++){
+    TEST_ASSERT_FALSE(ota_boot_failed(boot));
+  }
+  TEST_ASSERT_EQUAL_STRING("", boot.previous);
+  //labels longer than an ESP32 partition name are cut
+  ota_boot_updated(boot, "a_very_long_partition_label");
+  TEST_ASSERT_EQUAL(OTA_LABEL_SIZE-1, strlen(boot.previous));
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_write_verify);
+  RUN_TEST(test_piece_sizes);
+  RUN_TEST(test_sha_mismatch);
+  RUN_TEST(test_verify_failure);
+  RUN_TEST(test_too_large);
+  RUN_TEST(test_state);
+  RUN_TEST(test_rollback);
+  RUN_TEST(test_rollback_confirm);
+  return UNITY_END();
+}
@@ -0,0 +1,178 @@
+// lib/Stats on a file-backed flash with power cuts (tools/file_region.h):
+// record format, torn entry recovery and wear rotation of the stats log
+//
+// pio test -e native -f test_stats
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <stats.h>
+#include <stats_log.h>
+
+#include "../../tools/file_region.h"
+
+#define sector 4096
+#define log_sectors 4      // partitions.csv: stats, 0x4000
+
+static FILE *file;
+static faulty_region *flash;
+static stats_log slog;
+static size_t per_sector;
+
+static void open_flash(size_t sectors){
+  file = tmpfile();
+  std::vector<uint8_t> zero(sectors * sector, 0);
+  fwrite(zero.data(), 1, zero.size(), file);
+  flash = new faulty_region(file, zero.size());
+}
+
+// a total that differs from every other n
+static stats_record total(uint32_t n){
+  stats_record rec;
+  stats_tracker t;
+  stats_init(rec, t);
+  rec.boots = n;
+  for(int i=0; i<SWITCH_COUNT; i++){rec.flips[i] = n*(i+1);}
+  rec.latency[n % STATS_LATENCY_BUCKETS] = n;
+  rec.guard_wins = n/2;
+  rec.mode_seconds[n % STATS_MODES] = 600*n;
+  return rec;
+}
+
+static void assert_total(uint32_t n, const stats_record &rec){
+  uint8_t want[STATS_SIZE], got[STATS_SIZE];
+  stats_encode(total(n), want);
+  stats_encode(rec, got);
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(want, got, STATS_SIZE);
+}
+
+// power back: only what is in flash is left
+static stats_record reboot(){
+  stats_record rec;
+  flash->reboot();
+  TEST_ASSERT_TRUE(stats_log_open(slog, flash, rec));
+  return rec;
+}
+
+void setUp(){
+  open_flash(log_sectors);
+  per_sector = sector / STATS_ENTRY_SIZE;
+}
+
+void tearDown(){
+  delete flash;
+  fclose(file);
+}
+
+void test_codec(){
+  uint8_t data[STATS_SIZE];
+  stats_record rec;
+  stats_encode(total(7), data);
+  TEST_ASSERT_TRUE(stats_decode(data, STATS_SIZE, rec));
+  assert_total(7, rec);
+  TEST_ASSERT_FALSE(stats_decode(data, STATS_SIZE-1, rec));
+  data[3] = STATS_VERSION + 1;
+  TEST_ASSERT_FALSE(stats_decode(data, STATS_SIZE, rec));
+}
+
+void test_empty_and_small(){
+  //never erased flash has no valid entry, the total starts at zero
+  stats_record rec = reboot();
+  TEST_ASSERT_EQUAL(0, slog.entries);
+  TEST_ASSERT_EQUAL(0, rec.boots);
+  tearDown();
+  open_flash(1);
+  TEST_ASSERT_FALSE(stats_log_open(slog, flash, rec));
+}
+
+void test_append_reopen(){
+  reboot();
+  for(uint32_t n=1; n<=10; n++){
+    TEST_ASSERT_TRUE(stats_log_append(slog, total(n)));
+  }
+  stats_record rec = reboot();
+  assert_total(10, rec);
+  TEST_ASSERT_EQUAL(10, slog.seq);
+  TEST_ASSERT_EQUAL(10, slog.entries);
+  TEST_ASSERT_EQUAL(10*STATS_ENTRY_SIZE, slog.next);
+}
+
+void test_torn_entry(){
+  //a cut at every point of an entry write keeps the previous total,
+  //the next flush goes behind the torn entry (NOR flash cannot rewrite
+  //it before the next erase) and is found again
+  reboot();
+  uint32_t n = 1;
+  TEST_ASSERT_TRUE(stats_log_append(slog, total(n)));
+  for(long cut=1; cut<STATS_ENTRY_SIZE; cut+=3){
+    if(slog.next % sector == 0){
+      TEST_ASSERT_TRUE(stats_log_append(slog, total(++n)));
+    }
+    size_t torn = slog.next;
+    flash->cut = cut;
+    stats_log_append(slog, total(n+1));
+    stats_record rec = reboot();
+    assert_total(n, rec);
+    TEST_ASSERT_EQUAL(n, slog.seq);
+    TEST_ASSERT_TRUE(slog.next != torn);
+
+    TEST_ASSERT_TRUE(stats_log_append(slog, total(++n)));
+    rec = reboot();
+    assert_total(n, rec);
+  }
+}
+
+void test_torn_erase(){
+  //cut while the log erases the next sector: the old sector content is
+  //half gone, the total still comes from the last complete entry
+  reboot();
+  uint32_t n = 0;
+  while(n == 0 || slog.next % sector != 0){
+    TEST_ASSERT_TRUE(stats_log_append(slog, total(++n)));
+  }
+  TEST_ASSERT_EQUAL(per_sector, n);
+  for(long cut=1; cut<sector; cut+=sector/4){
+    flash->cut = cut;
+    TEST_ASSERT_FALSE(stats_log_append(slog, total(n+1)));
+    stats_record rec = reboot();
+    assert_total(n, rec);
+  }
+  TEST_ASSERT_TRUE(stats_log_append(slog, total(++n)));
+  stats_record rec = reboot();
+  assert_total(n, rec);
+}
+
+void test_wear_rotation(){
+  //round robin: after many laps every sector was erased equally often
+  reboot();
+  const uint32_t laps = 25;
+  const uint32_t count = laps * log_sectors * per_sector + per_sector/2;
+  for(uint32_t n=1; n<=count; n++){
+    TEST_ASSERT_TRUE(stats_log_append(slog, total(n)));
+    //a reboot now and then must not change where the log continues
+    if(n % 97 == 0){reboot();}
+  }
+  for(int s=0; s<log_sectors; s++){
+    char msg[32];
+    snprintf(msg, sizeof(msg), "sector %d", s);
+    TEST_ASSERT_UINT_WITHIN_MESSAGE(1, laps, flash->sector_erases[s], msg);
+  }
+  stats_record rec = reboot();
+  assert_total(count, rec);
+  TEST_ASSERT_EQUAL(count, slog.seq);
+  //the three sectors not erased last still hold full history
+  TEST_ASSERT_EQUAL((log_sectors-1) * per_sector + per_sector/2, slog.entries);
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_codec);
+  RUN_TEST(test_empty_and_small);
+  RUN_TEST(test_append_reopen);
+  RUN_TEST(test_torn_entry);
+  RUN_TEST(test_torn_erase);
+  RUN_TEST(test_wear_rotation);
+  return UNITY_END();
+}
@@ -0,0 +1,290 @@
+// Round trip of lib/Trace: trace_record -> trace_dump -> trace_parse
+//
+// pio test -e native -f test_trace
+
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <trace.h>
+
+#define sample_period 5   // codeForTouchTask [ms]
+#define trace_hours 4     // history /trace.bin has to cover
+
+static trace_buffer tb;
+static std::vector<uint8_t> dump;
+static std::vector<trace_sample> decoded;
+
+static uint32_t rng_state = 1;
+static uint32_t rng(){
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 17;
+  rng_state ^= rng_state << 5;
+  return rng_state;
+}
+
+static void collect_dump(const uint8_t *data, size_t len, void *ctx){
+  (void)ctx;
+  dump.insert(dump.end(), data, data+len);
+}
+
+static void collect_sample(const trace_sample &s, void *ctx){
+  (void)ctx;
+  decoded.push_back(s);
+}
+
+// touchRead() like values: idle at 30 flickering by 1 on every other
+// reading and by 2 on every 32nd, touches near 8 every two seconds,
+// a switch flip every three
+static std::vector<trace_sample> touch_samples(size_t count, uint32_t start){
+  std::vector<trace_sample> samples(count);
+  uint16_t level[TRACE_CHANNELS];
+  for(int c=0; c<TRACE_CHANNELS; c++){level[c] = 30;}
+  switchmap_t switches = 0;
+  for(size_t i=0; i<count; i++){
+    trace_sample &s = samples[i];
+    s.time = start + i*sample_period;
+    if(rng() % 400 == 0){
+      int c = rng() % TRACE_CHANNELS;
+      level[c] = level[c] == 30 ? 8 : 30;
+    }
+    if(rng() % 600 == 0){
+      switches ^= 1 << (rng() % SWITCH_COUNT);
+    }
+    for(int c=0; c<TRACE_CHANNELS; c++){
+      s.touch[c] = level[c];
+      uint32_t noise = rng() % 64;
+      if(noise < 32){s.touch[c] += noise % 2 ? 1 : -1;}
+      else if(noise < 34){s.touch[c] += noise % 2 ? 2 : -2;}
+    }
+    s.switches = switches;
+  }
+  return samples;
+}
+
+static void decode(){
+  dump.clear();
+  decoded.clear();
+  trace_dump(tb, collect_dump, NULL);
+  TEST_ASSERT_EQUAL(trace_dump_size(tb), dump.size());
+  long n = trace_parse(dump.data(), dump.size(), collect_sample, NULL);
+  TEST_ASSERT_EQUAL(decoded.size(), n);
+  TEST_ASSERT_TRUE(n > 0);
+}
+
+static void record(const std::vector<trace_sample> &samples, uint8_t deadband, uint16_t period = 0){
+  trace_init(tb, deadband, period);
+  for(size_t i=0; i<samples.size(); i++){
+    trace_record(tb, samples[i]);
+  }
+  decode();
+}
+
+// Compares every input sample from the first one still in the ring with the
+// decoded sample that was in effect at its time. Returns the largest touch
+// error, switches have to match exactly.
+static int replay_error(const std::vector<trace_sample> &samples){
+  size_t first = 0;
+  while(first < samples.size() && samples[first].time != decoded[0].time){first++;}
+  TEST_ASSERT_TRUE_MESSAGE(first < samples.size(), "first decoded sample is not an input sample");
+  //keyframes are exact
+  TEST_ASSERT_EQUAL_UINT16_ARRAY(samples[first].touch, decoded[0].touch, TRACE_CHANNELS);
+  TEST_ASSERT_EQUAL_HEX16(samples[first].switches, decoded[0].switches);
+
+  int worst = 0;
+  size_t d = 0;
+  for(size_t i=first; i<samples.size(); i++){
+    //decoded times follow the input order, also across a 32-bit wrap
+    while(d+1 < decoded.size() && decoded[d+1].time - samples[first].time <= samples[i].time - samples[first].time){d++;}
+    TEST_ASSERT_EQUAL_HEX16(samples[i].switches, decoded[d].switches);
+    for(int c=0; c<TRACE_CHANNELS; c++){
+      int err = abs((int)samples[i].touch[c] - decoded[d].touch[c]);
+      if(err > worst){worst = err;}
+    }
+  }
+  TEST_ASSERT_EQUAL(decoded.size()-1, d);
+  return worst;
+}
+
+void setUp(){
+  rng_state = 1;
+}
+
+void tearDown(){}
+
+void test_lossless_deadband_0(){
+  std::vector<trace_sample> samples = touch_samples(2000, 1000);
+  record(samples, 0);
+  TEST_ASSERT_EQUAL(0, replay_error(samples));
+}
+
+void test_lossless_deadband_1(){
+  std::vector<trace_sample> samples = touch_samples(2000, 1000);
+  record(samples, 1);
+  TEST_ASSERT_EQUAL(0, replay_error(samples));
+}
+
+void test_deadband_2_bound(){
+  std::vector<trace_sample> samples = touch_samples(2000, 1000);
+  record(samples, 2);
+  TEST_ASSERT_LESS_THAN(2, replay_error(samples));
+}
+
+void test_block_rollover(){
+  //a few blocks, every block starts with a keyframe of its first sample
+  std::vector<trace_sample> samples = touch_samples(600, 1000);
+  record(samples, 0);
+  TEST_ASSERT_TRUE(tb.blocks > 1 && tb.blocks <= TRACE_BLOCKS);
+  TEST_ASSERT_EQUAL_UINT32(samples[0].time, decoded[0].time);
+  TEST_ASSERT_EQUAL(0, replay_error(samples));
+}
+
+void test_ring_wrap(){
+  //the oldest blocks are overwritten, the dump starts at the oldest kept one
+  std::vector<trace_sample> samples = touch_samples(200000, 1000);
+  record(samples, 1);
+  TEST_ASSERT_TRUE(tb.blocks > TRACE_BLOCKS);
+  size_t data = 0;
+  for(int b=0; b<TRACE_BLOCKS; b++){data += tb.used[b];}
+  TEST_ASSERT_EQUAL(7 + TRACE_BLOCKS*2 + data, dump.size());
+  TEST_ASSERT_TRUE(decoded[0].time > samples[0].time);
+  TEST_ASSERT_EQUAL(0, replay_error(samples));
+}
+
+void test_dump_blocks(){
+  //block by block like GET /trace.bin gives the same bytes as trace_dump
+  std::vector<trace_sample> samples = touch_samples(200000, 1000);
+  record(samples, 1);
+  std::vector<uint8_t> pieces;
+  uint8_t out[2 + TRACE_BLOCK_SIZE];
+  pieces.insert(pieces.end(), out, out + trace_dump_head(out));
+  for(uint32_t b=trace_first_block(tb); b<tb.blocks; b++){
+    size_t len = trace_dump_block(tb, b, out);
+    TEST_ASSERT_TRUE(len > 2);
+    pieces.insert(pieces.end(), out, out+len);
+  }
+  TEST_ASSERT_TRUE(pieces == dump);
+  TEST_ASSERT_EQUAL(0, trace_dump_block(tb, trace_first_block(tb)-1, out));
+  TEST_ASSERT_EQUAL(0, trace_dump_block(tb, tb.blocks, out));
+}
+
+void test_time_wrap(){
+  //millis() wraps after 49.7 days
+  std::vector<trace_sample> samples = touch_samples(4000, 0xffffffffu - 10*1000);
+  TEST_ASSERT_TRUE(samples.back().time < samples.front().time);
+  record(samples, 0);
+  TEST_ASSERT_EQUAL(0, replay_error(samples));
+}
+
+void test_size_ratio(){
+  //raw: one keyframe per touch task sample still covered by the ring,
+  //as trace_replay --encode counts it
+  std::vector<trace_sample> samples = touch_samples(12000, 1000);
+  record(samples, 2);
+  TEST_ASSERT_LESS_THAN(2, replay_error(samples));
+  size_t covered = 0;
+  for(size_t i=0; i<samples.size(); i++){
+    if(samples[i].time - decoded[0].time < 0x80000000u){covered++;}
+  }
+  size_t raw = covered * TRACE_KEYFRAME_SIZE;
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%zu samples, %zu raw bytes -> %zu bytes", covered, raw, dump.size());
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_GREATER_OR_EQUAL_MESSAGE(10*dump.size(), raw, msg);
+}
+
+void test_period_window(){
+  //idle, a 20 ms touch on pad 0 and a read glitch on pad 1 inside one
+  //window, a switch flip in the middle of a later one
+  std::vector<trace_sample> samples(100);
+  for(size_t i=0; i<samples.size(); i++){
+    trace_sample &s = samples[i];
+    s.time = 1000 + i*sample_period;
+    for(int c=0; c<TRACE_CHANNELS; c++){s.touch[c] = 30;}
+    s.switches = i < 63 ? 0 : 1;
+  }
+  for(int i=12; i<16; i++){samples[i].touch[0] = 8;}
+  samples[13].touch[1] = 0;
+  record(samples, 0, 50);
+
+  TEST_ASSERT_EQUAL_UINT32(1000, decoded[0].time);
+  size_t touched = decoded.size();
+  size_t flip = decoded.size();
+  for(size_t d=0; d<decoded.size(); d++){
+    TEST_ASSERT_TRUE((decoded[d].time - 1000) % 50 == 0 || (decoded[d].time - 1315) % 50 == 0);
+    TEST_ASSERT_EQUAL_UINT16(30, decoded[d].touch[1]);
+    if(decoded[d].touch[0] == 8 && touched == decoded.size()){touched = d;}
+    if(decoded[d].switches && flip == decoded.size()){flip = d;}
+  }
+  TEST_ASSERT_TRUE(touched < decoded.size());
+  TEST_ASSERT_EQUAL_UINT32(1050, decoded[touched].time);
+  TEST_ASSERT_EQUAL_UINT16(30, decoded[touched+1].touch[0]);
+  TEST_ASSERT_TRUE(flip < decoded.size());
+  TEST_ASSERT_EQUAL_UINT32(1315, decoded[flip].time);
+}
+
+void test_ring_coverage(){
+  //a box in use with the firmware's settings: a touch every minute for
+  //0.5 to 3 s, a switch flip every three minutes that the arm resets
+  //within a second, idle pads flickering like touch_samples
+  trace_init(tb, TRACE_DEADBAND, TRACE_PERIOD);
+  int pad = -1;
+  uint32_t pad_until = 0;
+  switchmap_t switches = 0;
+  const uint32_t end = 1000 + trace_hours*3600ul*1000;
+  for(uint32_t time=1000; time<end; time+=sample_period){
+    if(pad < 0 && rng() % 12000 == 0){
+      pad = rng() % TRACE_CHANNELS;
+      pad_until = time + 500 + rng() % 2500;
+    }
+    if(pad >= 0 && time >= pad_until){pad = -1;}
+    if(rng() % 36000 == 0){switches |= 1 << (rng() % SWITCH_COUNT);}
+    if(switches && rng() % 200 == 0){switches = 0;}
+
+    trace_sample s;
+    s.time = time;
+    for(int c=0; c<TRACE_CHANNELS; c++){
+      s.touch[c] = c == pad ? 8 : 30;
+      uint32_t noise = rng() % 64;
+      if(noise < 32){s.touch[c] += noise % 2 ? 1 : -1;}
+      else if(noise < 34){s.touch[c] += noise % 2 ? 2 : -2;}
+    }
+    s.switches = switches;
+    trace_record(tb, s);
+  }
+  decode();
+  char msg[96];
+  snprintf(msg, sizeof(msg), "%lu blocks of %d for %d h", (unsigned long)tb.blocks, TRACE_BLOCKS, trace_hours);
+  TEST_MESSAGE(msg);
+  //nothing overwritten yet, the dump still starts with the first sample
+  TEST_ASSERT_TRUE_MESSAGE(tb.blocks <= TRACE_BLOCKS, msg);
+  TEST_ASSERT_EQUAL_UINT32(1000, decoded[0].time);
+}
+
+void test_malformed(){
+  std::vector<trace_sample> samples = touch_samples(500, 1000);
+  record(samples, 0);
+  std::vector<uint8_t> bad = dump;
+  bad[3] = TRACE_VERSION + 1;
+  TEST_ASSERT_EQUAL(-1, trace_parse(bad.data(), bad.size(), collect_sample, NULL));
+  bad = dump;
+  bad.resize(bad.size() - 1);
+  TEST_ASSERT_EQUAL(-1, trace_parse(bad.data(), bad.size(), collect_sample, NULL));
+}
+
+int main(){
+  UNITY_BEGIN();
+  RUN_TEST(test_lossless_deadband_0);
+  RUN_TEST(test_lossless_deadband_1);
+  RUN_TEST(test_deadband_2_bound);
+  RUN_TEST(test_block_rollover);
+  RUN_TEST(test_ring_wrap);
+  RUN_TEST(test_dump_blocks);
+  RUN_TEST(test_time_wrap);
+  RUN_TEST(test_size_ratio);
+  RUN_TEST(test_period_window);
+  RUN_TEST(test_ring_coverage);
+  RUN_TEST(test_malformed);
+  return UNITY_END();
+}
@@ -0,0 +1,89 @@
+#ifndef FILE_REGION_H
+#define FILE_REGION_H
+
+// Host stand-ins for a flash partition, shared by the tools and test/
+
+#include <stdio.h>
+#include <vector>
+
+#include <flash_region.h>
+
+// file with NOR flash semantics: erase to 0xff, writes only clear bits
+class file_region : public flash_region {
+public:
+  file_region(FILE *file, size_t size) : file(file), length(size), erases(0), writes(0) {}
+
+  size_t size(){return length;}
+  size_t sector_size(){return 4096;}
+
+  bool erase(size_t offset, size_t len){
+    if(offset % 4096 || len % 4096 || offset + len > length){return false;}
+    std::vector<uint8_t> ff(len, 0xff);
+    erases++;
+    return fseek(file, offset, SEEK_SET) == 0 && fwrite(ff.data(), 1, len, file) == len;
+  }
+
+  bool write(size_t offset, const uint8_t *data, size_t len){
+    if(offset + len > length){return false;}
+    std::vector<uint8_t> old(len);
+    if(!read(offset, old.data(), len)){return false;}
+    for(size_t i=0; i<len; i++){
+      old[i] &= data[i];
+    }
+    writes++;
+    return fseek(file, offset, SEEK_SET) == 0 && fwrite(old.data(), 1, len, file) == len;
+  }
+
+  bool read(size_t offset, uint8_t *data, size_t len){
+    if(offset + len > length){return false;}
+    return fseek(file, offset, SEEK_SET) == 0 && fread(data, 1, len, file) == len;
+  }
+
+  FILE *file;
+  size_t length;
+  unsigned erases;
+  unsigned writes;
+};
+
+// flash that loses power: after cut bytes a write or erase stops and
+// everything fails until reboot()
+class faulty_region : public file_region {
+public:
+  faulty_region(FILE *file, size_t size) : file_region(file, size), cut(-1), dead(false), sector_erases(size/4096) {}
+
+  bool erase(size_t offset, size_t len){
+    if(dead){return false;}
+    if(cut >= 0){
+      //part of the sector is erased, the rest keeps its old content
+      std::vector<uint8_t> ff(cut % len, 0xff);
+      fseek(file, offset, SEEK_SET);
+      fwrite(ff.data(), 1, ff.size(), file);
+      dead = true;
+      return false;
+    }
+    sector_erases[offset/4096]++;
+    return file_region::erase(offset, len);
+  }
+
+  bool write(size_t offset, const uint8_t *data, size_t len){
+    if(dead){return false;}
+    if(cut >= 0){
+      //torn write, reports success like a real cut would never report
+      file_region::write(offset, data, cut % len);
+      dead = true;
+      return true;
+    }
+    return file_region::write(offset, data, len);
+  }
+
+  void reboot(){
+    cut = -1;
+    dead = false;
+  }
+
+  long cut;
+  bool dead;
+  std::vector<unsigned> sector_erases;
+};
+
+#endif
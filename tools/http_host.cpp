@@ -0,0 +1,290 @@
+// Serves the web routes of lib/Http/box_routes.cpp on Linux
+//
+// build: g++ -std=c++11 -Ilib/BoxLogic -Ilib/Http tools/http_host.cpp
+//          lib/Http/http.cpp lib/Http/box_routes.cpp -o http_host
+//
+// http_host [port] [asset dir]      defaults: 8080 data
+//
+// Like ESPAsyncWebServer all requests are handled by one event loop and
+// every connection is closed after its response. The box state is
+// simulated: switches and touch values change every few seconds.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <board.h>
+#include <box_routes.h>
+
+static std::string asset_dir = "data";
+static std::map<std::string, std::string> boxes;
+static unsigned long started;
+
+static unsigned long millis(){
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec*1000UL + ts.tv_nsec/1000000;
+}
+
+static bool read_asset(const std::string &path, std::string &out){
+  FILE *f = fopen((asset_dir + path).c_str(), "rb");
+  if(!f){return false;}
+  char buffer[4096];
+  size_t n;
+  out.clear();
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+    out.append(buffer, n);
+  }
+  fclose(f);
+  return true;
+}
+
+// simulated box ---------------------------------------------------------
+
+static switchmap_t sim_switches(){
+  unsigned long t = (millis() - started)/3000;
+  return t % 3 == 0 ? 1 << (t % SWITCH_COUNT) : 0;
+}
+
+static uint16_t sim_touch(int i){
+  return 30 + (millis()/100 + i) % 3;
+}
+
+static void snapshot(box_state &state, uint8_t parts){
+  (void)parts;
+  state.uptime = millis() - started;
+  state.mode = "Touch";
+  state.battery = false;
+  state.serial = false;
+  state.reset = true;
+  state.switches = sim_switches();
+  for(int i=0; i<SWITCH_COUNT; i++){
+    state.touch_status[i] = 0;
+    state.touch_value[i] = sim_touch(i);
+    state.config[i][0] = 8;
+    state.config[i][1] = 30;
+    state.config[i][2] = 15;
+  }
+}
+
+static const char *box_template(const char *file, size_t *len){
+  std::string &box = boxes[file];
+  if(box.empty()){read_asset(file, box);}
+  *len = box.size();
+  return box.data();
+}
+
+static void move(int x, int y){
+  (void)x;
+  (void)y;
+}
+
+static const box_app app = {snapshot, box_template, move};
+
+// http binding --------------------------------------------------------
+
+static const char *status_text(int status){
+  switch(status)
+  {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 503: return "Service Unavailable";
+  }
+  return "Error";
+}
+
+class posix_request : public http_request {
+public:
+  posix_request(const std::string &target){
+    size_t q = target.find('?');
+    url = target.substr(0, q);
+    if(q != std::string::npos){query = target.substr(q+1);}
+  }
+
+  const char *path(){return url.c_str();}
+
+  bool param(const char *name, char *out, size_t cap){
+    size_t len = strlen(name);
+    size_t pos = 0;
+    while(pos <= query.size()){
+      size_t end = query.find('&', pos);
+      if(end == std::string::npos){end = query.size();}
+      if(query.compare(pos, len, name) == 0 && pos+len < end && query[pos+len] == '='){
+        std::string val = query.substr(pos+len+1, end-pos-len-1);
+        snprintf(out, cap, "%s", val.c_str());
+        return true;
+      }
+      pos = end + 1;
+    }
+    return false;
+  }
+
+private:
+  std::string url;
+  std::string query;
+};
+
+class posix_response : public http_response {
+public:
+  void send(int status, const char *type, const char *body){
+    head(status, type, NULL, NULL);
+    out += body;
+  }
+
+  void send_file(const char *path, const char *type, const char *encoding, const char *cache){
+    std::string data;
+    if(!read_asset(path, data)){
+      send(404, "text/plain", "Not found");
+      return;
+    }
+    head(200, type, encoding, cache);
+    out += data;
+  }
+
+  void begin(const char *type){
+    head(200, type, NULL, NULL);
+  }
+
+  void write(const char *data, size_t len){
+    out.append(data, len);
+  }
+
+  std::string out;
+
+private:
+  void head(int status, const char *type, const char *encoding, const char *cache){
+    char buffer[256];
+    int n = snprintf(buffer, sizeof(buffer), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nConnection: close\r\n",
+                     status, status_text(status), type);
+    out.assign(buffer, n);
+    if(encoding){out += std::string("Content-Encoding: ") + encoding + "\r\n";}
+    if(cache){
+      n = snprintf(buffer, sizeof(buffer), "Cache-Control: %s\r\n", cache);
+      out.append(buffer, n);
+    }
+    out += "\r\n";
+  }
+};
+
+static std::string handle(const std::string &head){
+  posix_response res;
+  size_t sp1 = head.find(' ');
+  size_t sp2 = head.find(' ', sp1+1);
+  if(sp1 == std::string::npos || sp2 == std::string::npos || head.compare(0, sp1, "GET") != 0){
+    res.send(400, "text/plain", "Bad request");
+    return res.out;
+  }
+  posix_request req(head.substr(sp1+1, sp2-sp1-1));
+  const http_route *route = http_find(box_routes, box_route_count, req.path());
+  if(route == NULL){
+    res.send(404, "text/plain", "Not found");
+  }
+  else{
+    route->handler(req, res, *route);
+  }
+  return res.out;
+}
+
+// event loop ----------------------------------------------------------
+
+struct connection {
+  int fd;
+  std::string in;
+  std::string out;
+  size_t sent;
+};
+
+int main(int argc, char **argv){
+  int port = argc > 1 ? atoi(argv[1]) : 8080;
+  if(argc > 2){asset_dir = argv[2];}
+  signal(SIGPIPE, SIG_IGN);
+  started = millis();
+  box_routes_init(&app);
+
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if(bind(listener, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 128) < 0){
+    perror("listen");
+    return 1;
+  }
+  fcntl(listener, F_SETFL, O_NONBLOCK);
+  fprintf(stderr, "serving %s on port %d, %d switches\n", asset_dir.c_str(), port, SWITCH_COUNT);
+
+  std::vector<connection> conns;
+  for(;;){
+    std::vector<pollfd> fds(1);
+    fds[0].fd = listener;
+    fds[0].events = POLLIN;
+    for(size_t i=0; i<conns.size(); i++){
+      pollfd p = {conns[i].fd, (short)(conns[i].out.empty() ? POLLIN : POLLOUT), 0};
+      fds.push_back(p);
+    }
+    if(poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR){
+      perror("poll");
+      return 1;
+    }
+
+    if(fds[0].revents & POLLIN){
+      int fd;
+      while((fd = accept(listener, NULL, NULL)) >= 0){
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        connection c = {fd, std::string(), std::string(), 0};
+        conns.push_back(c);
+      }
+    }
+
+    for(size_t i=1; i<fds.size(); i++){
+      connection &c = conns[i-1];
+      if(fds[i].revents & POLLIN){
+        char buffer[2048];
+        ssize_t n = read(c.fd, buffer, sizeof(buffer));
+        if(n <= 0){
+          close(c.fd);
+          c.fd = -1;
+          continue;
+        }
+        c.in.append(buffer, n);
+        size_t end = c.in.find("\r\n\r\n");
+        if(end != std::string::npos){
+          c.out = handle(c.in.substr(0, c.in.find("\r\n")));
+        }
+      }
+      if(fds[i].revents & POLLOUT){
+        ssize_t n = ::write(c.fd, c.out.data()+c.sent, c.out.size()-c.sent);
+        if(n > 0){c.sent += n;}
+        if(n < 0 || c.sent == c.out.size()){
+          close(c.fd);
+          c.fd = -1;
+        }
+      }
+      if(fds[i].revents & (POLLERR | POLLHUP) && c.fd >= 0){
+        close(c.fd);
+        c.fd = -1;
+      }
+    }
+
+    std::vector<connection> open;
+    for(size_t i=0; i<conns.size(); i++){
+      if(conns[i].fd >= 0){open.push_back(conns[i]);}
+    }
+    conns.swap(open);
+  }
+}
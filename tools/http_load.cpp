@@ -0,0 +1,145 @@
+// Load generator for the web interface (device or tools/http_host)
+//
+// build: g++ -std=c++11 -O2 -pthread tools/http_load.cpp -o http_load
+//
+// http_load <host ip> [port] [clients] [seconds] [--flood]
+//
+// Every client behaves like an open index.html: main.js fetches
+// info_box.html, 20 ms later switch_box.html, and repeats every second.
+// --flood drops the pauses and sends the same pair back to back.
+// Prints throughput, errors and latency percentiles per request.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock load_clock;
+
+static sockaddr_in target;
+static bool flood = false;
+static load_clock::time_point deadline;
+
+static std::mutex result_lock;
+static std::vector<double> latencies;   // ms, successful requests only
+static std::atomic<long> errors(0);
+static std::atomic<long> bytes(0);
+
+// One request on a fresh connection, the server closes after the response.
+// Returns the body size or -1.
+static long get(const char *path){
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(fd < 0){return -1;}
+  timeval tv = {5, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  if(connect(fd, (sockaddr*)&target, sizeof(target)) < 0){
+    close(fd);
+    return -1;
+  }
+  char request[256];
+  int n = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: box\r\nConnection: close\r\n\r\n", path);
+  if(send(fd, request, n, 0) != n){
+    close(fd);
+    return -1;
+  }
+  std::string response;
+  char buffer[4096];
+  ssize_t r;
+  while((r = recv(fd, buffer, sizeof(buffer), 0)) > 0){
+    response.append(buffer, r);
+  }
+  close(fd);
+  size_t body = response.find("\r\n\r\n");
+  if(r < 0 || body == std::string::npos || response.compare(0, 12, "HTTP/1.1 200") != 0){
+    return -1;
+  }
+  return response.size() - body - 4;
+}
+
+static void timed_get(const char *path, std::vector<double> &local){
+  load_clock::time_point start = load_clock::now();
+  long size = get(path);
+  if(size < 0){
+    errors++;
+    return;
+  }
+  bytes += size;
+  local.push_back(std::chrono::duration<double, std::milli>(load_clock::now() - start).count());
+}
+
+static void client(int id){
+  std::vector<double> local;
+  load_clock::time_point next = load_clock::now() + std::chrono::milliseconds(37 * id % 1000);
+  if(!flood){std::this_thread::sleep_until(next);}
+  while(load_clock::now() < deadline){
+    timed_get("/info_box.html", local);
+    if(!flood){std::this_thread::sleep_for(std::chrono::milliseconds(20));}
+    timed_get("/switch_box.html", local);
+    if(!flood){
+      next += std::chrono::seconds(1);
+      std::this_thread::sleep_until(next);
+    }
+  }
+  std::lock_guard<std::mutex> guard(result_lock);
+  latencies.insert(latencies.end(), local.begin(), local.end());
+}
+
+static double percentile(const std::vector<double> &sorted, double p){
+  if(sorted.empty()){return 0;}
+  size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+int main(int argc, char **argv){
+  std::vector<const char*> args;
+  for(int i=1; i<argc; i++){
+    if(strcmp(argv[i], "--flood") == 0){flood = true;}
+    else{args.push_back(argv[i]);}
+  }
+  if(args.empty()){
+    fprintf(stderr, "usage: http_load <host ip> [port] [clients] [seconds] [--flood]\n");
+    return 1;
+  }
+  int port = args.size() > 1 ? atoi(args[1]) : 80;
+  int clients = args.size() > 2 ? atoi(args[2]) : 4;
+  int seconds = args.size() > 3 ? atoi(args[3]) : 10;
+
+  memset(&target, 0, sizeof(target));
+  target.sin_family = AF_INET;
+  target.sin_port = htons(port);
+  if(inet_pton(AF_INET, args[0], &target.sin_addr) != 1){
+    fprintf(stderr, "not an IPv4 address: %s\n", args[0]);
+    return 1;
+  }
+
+  load_clock::time_point start = load_clock::now();
+  deadline = start + std::chrono::seconds(seconds);
+  std::vector<std::thread> threads;
+  for(int i=0; i<clients; i++){
+    threads.push_back(std::thread(client, i));
+  }
+  for(size_t i=0; i<threads.size(); i++){
+    threads[i].join();
+  }
+  double elapsed = std::chrono::duration<double>(load_clock::now() - start).count();
+
+  std::sort(latencies.begin(), latencies.end());
+  printf("%d clients, %s, %.1f s\n", clients, flood ? "flood" : "polling like main.js", elapsed);
+  printf("requests  %zu ok, %ld failed\n", latencies.size(), (long)errors);
+  printf("throughput %.1f req/s, %.1f kB/s\n", latencies.size() / elapsed, bytes / elapsed / 1000);
+  printf("latency   p50 %.2f ms  p95 %.2f ms  p99 %.2f ms  max %.2f ms\n",
+         percentile(latencies, 0.50), percentile(latencies, 0.95), percentile(latencies, 0.99),
+         latencies.empty() ? 0 : latencies.back());
+  return errors > 0;
+}
@@ -0,0 +1,135 @@
+// Per-call cost of LOG() against printing directly
+//
+// build: g++ -std=c++11 -O2 -pthread -Ilib/Log tools/log_bench.cpp lib/Log/log.cpp -o log_bench
+//
+// log_bench [calls]      default 2000000
+//
+// LOG() runs with the drain task as a thread that formats every record,
+// like the box does with serial active. Producers write bursts of half a
+// ring and wait for the drain in between, so nothing is dropped and only
+// the calls are timed. Direct printing is what codeForMoveTask did:
+// formatting plus an unbuffered write per message.
+// The UART line shows how long Serial.print blocks once the 128 byte FIFO
+// is full: 115200 baud are 86.8 us per byte.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <log.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static bench_clock::time_point started = bench_clock::now();
+
+static uint32_t clock_us(){
+  return std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now() - started).count();
+}
+
+static std::atomic<bool> draining(false);
+static std::atomic<unsigned long> drained(0);
+
+static void drain(){
+  log_record rec;
+  char line[160];
+  unsigned long n = 0;
+  //pop first, the stop flag only ends the loop once the ring is empty
+  for(;;){
+    if(log_read(log_main, rec)){
+      log_format(rec, line, sizeof(line));
+      n++;
+    }
+    else if(!draining){
+      break;
+    }
+    else{
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  drained = n;
+}
+
+static double ns_per_call(bench_clock::time_point start, long calls){
+  return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / calls;
+}
+
+// LOG from producer threads in bursts that fit into the ring, only the
+// calls are timed, not the wait for the drain. Returns ns per call,
+// dropped and formatted records add up to the LOG calls.
+static double bench_log(long calls, int producers, uint32_t &dropped, unsigned long &formatted){
+  log_init(clock_us);
+  log_level = LOG_DEBUG;
+  draining = true;
+  std::thread consumer(drain);
+  std::vector<std::thread> threads;
+  std::vector<double> busy(producers);
+  const long burst = LOG_RING_SIZE / 2 / producers;
+  for(int p=0; p<producers; p++){
+    threads.push_back(std::thread([calls, producers, burst, p, &busy](){
+      double ns = 0;
+      for(long i=0; i<calls/producers; i+=burst){
+        bench_clock::time_point start = bench_clock::now();
+        for(long k=i; k<i+burst && k<calls/producers; k++){
+          LOG(move_pos, 1100 + (k & 511), 750 + (k & 1023));
+        }
+        ns += std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+        while(__atomic_load_n(&log_main.head, __ATOMIC_RELAXED) - __atomic_load_n(&log_main.tail, __ATOMIC_RELAXED) > LOG_RING_SIZE/2){
+          std::this_thread::yield();
+        }
+      }
+      busy[p] = ns;
+    }));
+  }
+  double ns = 0;
+  for(int p=0; p<producers; p++){
+    threads[p].join();
+    ns += busy[p];
+  }
+  draining = false;
+  consumer.join();
+  dropped = log_main.dropped;
+  formatted = drained;
+  return ns / calls;
+}
+
+int main(int argc, char **argv){
+  long calls = argc > 1 ? atol(argv[1]) : 2000000;
+
+  //level check only
+  log_init(clock_us);
+  log_level = LOG_OFF;
+  bench_clock::time_point start = bench_clock::now();
+  for(long i=0; i<calls; i++){
+    LOG(move_pos, i, i);
+  }
+  double off = ns_per_call(start, calls);
+
+  uint32_t dropped1, dropped2;
+  unsigned long formatted1, formatted2;
+  double one = bench_log(calls, 1, dropped1, formatted1);
+  double two = bench_log(calls, 2, dropped2, formatted2);
+
+  //formatting and an unbuffered write per message
+  FILE *out = fopen("/dev/null", "w");
+  setvbuf(out, NULL, _IONBF, 0);
+  long direct_calls = calls / 10;
+  long bytes = 0;
+  start = bench_clock::now();
+  for(long i=0; i<direct_calls; i++){
+    bytes += fprintf(out, "push: %ld | rot: %ld\n", 1100 + (i & 511), 750 + (i & 1023));
+  }
+  double direct = ns_per_call(start, direct_calls);
+  fclose(out);
+  double uart = 86.8e3 * bytes / direct_calls;
+
+  printf("%ld calls, ring of %d records\n", calls, LOG_RING_SIZE);
+  printf("LOG, level off           %8.1f ns/call\n", off);
+  printf("LOG, 1 producer          %8.1f ns/call, %lu formatted, %u dropped\n", one, formatted1, dropped1);
+  printf("LOG, 2 producers         %8.1f ns/call, %lu formatted, %u dropped\n", two, formatted2, dropped2);
+  printf("fprintf unbuffered       %8.1f ns/call\n", direct);
+  printf("Serial 115200, FIFO full %8.1f us/call for %.1f bytes\n", uart / 1000, (double)bytes / direct_calls);
+  return 0;
+}
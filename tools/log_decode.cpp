@@ -0,0 +1,45 @@
+// Decodes the binary log stream of a box built with LOG_SERIAL_BINARY
+//
+// build: g++ -std=c++11 -Ilib/Log tools/log_decode.cpp lib/Log/log.cpp -o log_decode
+//
+// log_decode [capture]      reads stdin without a file, e.g.
+//     stty -F /dev/ttyUSB0 115200 raw && log_decode < /dev/ttyUSB0
+//
+// Bytes outside of valid frames (boot ROM output, line noise) are skipped.
+// The message table comes from lib/Log/log_messages.h, decode with the
+// revision the firmware was built from.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <log.h>
+
+int main(int argc, char **argv){
+  FILE *in = stdin;
+  if(argc > 1){
+    in = fopen(argv[1], "rb");
+    if(!in){
+      perror(argv[1]);
+      return 1;
+    }
+  }
+
+  log_parser parser;
+  log_parser_init(parser);
+  log_record rec;
+  unsigned long records = 0;
+  char line[160];
+  int c;
+  while((c = fgetc(in)) != EOF){
+    if(!log_parse(parser, c, rec)){continue;}
+    records++;
+    if(rec.id == log_start && rec.argc == 2 && rec.args[1] != log_count){
+      fprintf(stderr, "firmware has %ld messages, this decoder %d\n", (long)rec.args[1], log_count);
+    }
+    log_format(rec, line, sizeof(line));
+    puts(line);
+    fflush(stdout);
+  }
+  fprintf(stderr, "%lu records, %lu bytes skipped\n", records, parser.skipped);
+  return 0;
+}
@@ -0,0 +1,400 @@
+// Offline tuner for the motion profile (lib/BoxLogic/motion.h)
+//
+// build: g++ -std=c++11 -O2 -Ilib/BoxLogic -Ilib/Trace tools/motion_tune.cpp lib/BoxLogic/box_logic.cpp
+//          lib/BoxLogic/predict.cpp lib/BoxLogic/base_sim.cpp lib/Trace/trace.cpp -o motion_tune
+//        add the board flag of the hardware revision, e.g. -DBOARD_BOX8
+//
+// motion_tune [--measure file]... [--trace trace.bin [--threshold th]]
+//             [--seed n] [--flips n] [--margin percent] [--pulse-margin us]
+//             [--min-prepare s] [--pressed-max us] [--servo-weight w]
+//             [--current] [-o motion_profile.h]
+//
+// Fits a servo and switch timing model to measurements, replays the flips
+// and touches of a trace (or a synthetic workload) through codeForBaseTask
+// (lib/BoxLogic/base_sim.h) and searches the profile with the lowest mean
+// flip-to-reset latency plus servo-weight * servo time per flip. Every
+// delay after a move covers the modelled travel plus margin, push pulses
+// keep pulse-margin to the switch contact and stay within the arm_move_*
+// limits of lib/BoxLogic/motion.h. --current evaluates the hand-picked profile of the first box.
+// Same inputs give the same header byte for byte.
+//
+// measure files, one measurement per line, # comments:
+//   rot|push|lid <from us> <to us> <ms>   servo at rest after ms (video, scope)
+//   contact <us>                          push pulse where the switch turns off
+// log_decode output is read as well: the push_done records of push_switch
+// are push measurements up to the contact, rounded up to push_poll.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <box_logic.h>
+#include <base_sim.h>
+#include <trace.h>
+
+#define servo_frame 20     // a write takes effect with the next PWM frame [ms]
+#define grid 5             // delay resolution [ms]
+#define min_gain 1.0       // smaller cost differences are workload noise [ms]
+
+static const motion_profile hand_picked = {100, 150, 100, 200, 100, 100, 1700, 1900, 1, 2};
+
+// timing model -------------------------------------------------------
+
+struct measurement {
+  double dist;
+  double ms;
+};
+
+// least squares fit of ms = dead + per_us*dist, then shifted up so that
+// the model is not faster than any measurement
+static servo_model fit(const std::vector<measurement> &data, servo_model def){
+  size_t n = data.size();
+  if(n == 0){return def;}
+  double md = 0, mt = 0;
+  for(size_t i=0; i<n; i++){
+    md += data[i].dist;
+    mt += data[i].ms;
+  }
+  md /= n;
+  mt /= n;
+  double cov = 0, var = 0;
+  for(size_t i=0; i<n; i++){
+    cov += (data[i].dist - md)*(data[i].ms - mt);
+    var += (data[i].dist - md)*(data[i].dist - md);
+  }
+  servo_model m = def;
+  m.samples = n;
+  if(var > 1e-9 && cov > 0){
+    m.per_us = cov/var;
+    m.dead = mt - m.per_us*md;
+  }
+  else if(md > 0){
+    m.per_us = (mt - def.dead)/md;
+  }
+  if(m.per_us < 0){m.per_us = 0;}
+  if(m.dead < 0){m.dead = 0;}
+  double worst = 0;
+  for(size_t i=0; i<n; i++){
+    double over = data[i].ms - (m.dead + m.per_us*data[i].dist);
+    if(over > worst){worst = over;}
+  }
+  m.dead += worst;
+  return m;
+}
+
+static bool load_measurements(const char *path, std::vector<measurement> data[3],
+                              std::vector<measurement> &presses, int &contact){
+  FILE *f = fopen(path, "r");
+  if(!f){return false;}
+  char line[256];
+  int number = 0;
+  while(fgets(line, sizeof(line), f)){
+    number++;
+    const char *log = strstr(line, "push from ");
+    long from, to, ms;
+    double t;
+    if(log){
+      if(sscanf(log, "push from %ld: switch off after %ld ms", &from, &ms) == 2){
+        measurement m = {(double)from, (double)ms};
+        presses.push_back(m);
+      }
+      continue;
+    }
+    char *comment = strchr(line, '#');
+    if(comment){*comment = 0;}
+    char name[16];
+    int fields = sscanf(line, "%15s %ld %ld %lf", name, &from, &to, &t);
+    if(fields <= 0){continue;}
+    if(fields == 2 && strcmp(name, "contact") == 0){
+      contact = from;
+      continue;
+    }
+    static const char *servos[3] = {"rot", "push", "lid"};
+    int s = 0;
+    while(s < 3 && strcmp(name, servos[s]) != 0){s++;}
+    if(s == 3 || fields != 4){
+      fprintf(stderr, "%s:%d: unknown measurement\n", path, number);
+      fclose(f);
+      return false;
+    }
+    measurement m = {(double)labs(to - from), t};
+    data[s].push_back(m);
+  }
+  fclose(f);
+  return true;
+}
+
+// workload -----------------------------------------------------------
+
+static void collect(const trace_sample &s, void *ctx){
+  sim_trace_sample(*(sim_trace*)ctx, s.time, s.switches, s.touch);
+}
+
+static bool load_trace(const char *path, uint16_t th, sim_workload &w){
+  FILE *f = fopen(path, "rb");
+  if(!f){return false;}
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+    data.insert(data.end(), buffer, buffer+n);
+  }
+  fclose(f);
+  sim_trace ctx;
+  sim_trace_init(ctx, w, th);
+  return trace_parse(data.data(), data.size(), collect, &ctx) >= 0;
+}
+
+static double cost(const sim_result &r, double servo_weight){
+  return r.latency + servo_weight*r.servo;
+}
+
+// search -------------------------------------------------------------
+
+struct limits {
+  double margin;       // on every modelled travel
+  int pulse_margin;    // [us] between push pulses and the contact
+  int min_prepare;     // [s]
+  int pressed_max;     // [us]
+};
+
+static uint16_t round_up(double ms){
+  if(ms <= 0){return 0;}
+  return (uint16_t)(ceil(ms/grid - 1e-9)*grid);
+}
+
+// smallest delays that cover the travel of each move
+static void fit_delays(motion_profile &p, const box_model &m, const limits &l){
+  double k = 1 + l.margin;
+  double slot = 0;
+  for(int a=0; a<SWITCH_COUNT; a++){
+    for(int b=0; b<SWITCH_COUNT; b++){
+      if(a == b){continue;}
+      double need = (k*sim_travel(m.rot, board_switch_pos[a] - board_switch_pos[b]) - p.settle)/abs(a - b);
+      if(need > slot){slot = need;}
+    }
+  }
+  p.slot = round_up(slot);
+  p.lid = round_up(k*sim_travel(m.lid, deckel_auf - deckel_min) - p.settle);
+  //PREPARE leaves the arm at arm_move_push_max, the lid closes right after retreat
+  p.retreat = round_up(k*sim_travel(m.push, arm_move_push_max - arm_move_push_min) - p.settle);
+  //back below the contact before the next rotation
+  p.release = round_up(k*sim_travel(m.push, p.arm_pressed - (m.contact - l.pulse_margin)) - p.settle);
+}
+
+static bool check(const motion_profile &p, const box_model &m, const limits &l, bool report){
+  motion_profile need = p;
+  fit_delays(need, m, l);
+  bool ok = true;
+  struct {const char *name; uint16_t have, need;} delays[] = {
+    {"slot", p.slot, need.slot}, {"lid", p.lid, need.lid},
+    {"retreat", p.retreat, need.retreat}, {"release", p.release, need.release}};
+  for(int i=0; i<4; i++){
+    if(delays[i].have < delays[i].need){
+      if(report){fprintf(stderr, "  %s %u ms < %u ms\n", delays[i].name, delays[i].have, delays[i].need);}
+      ok = false;
+    }
+  }
+  if(p.settle < servo_frame){
+    if(report){fprintf(stderr, "  settle %u ms < %d ms\n", p.settle, servo_frame);}
+    ok = false;
+  }
+  if(p.arm_waiting < arm_move_push_min || p.arm_waiting > arm_move_push_max || p.arm_waiting > m.contact - l.pulse_margin){
+    if(report){fprintf(stderr, "  arm_waiting %u us not in %d..%d us\n", p.arm_waiting, arm_move_push_min,
+                       m.contact - l.pulse_margin < arm_move_push_max ? m.contact - l.pulse_margin : arm_move_push_max);}
+    ok = false;
+  }
+  //motion.h asserts arm_pressed past arm_move_push_max
+  int pressed_min = m.contact + l.pulse_margin > arm_move_push_max ? m.contact + l.pulse_margin : arm_move_push_max + 1;
+  if(p.arm_pressed < pressed_min || p.arm_pressed > l.pressed_max){
+    if(report){fprintf(stderr, "  arm_pressed %u us not in %d..%d us\n", p.arm_pressed, pressed_min, l.pressed_max);}
+    ok = false;
+  }
+  if(p.prepare_after < l.min_prepare || p.follow_after > p.prepare_after){
+    if(report){fprintf(stderr, "  dwell %u/%u s, prepare needs >= %d s\n", p.follow_after, p.prepare_after, l.min_prepare);}
+    ok = false;
+  }
+  return ok;
+}
+
+struct parameter {
+  const char *name;
+  uint16_t motion_profile::*field;
+  int lo, hi, step;
+};
+
+// coordinate descent over the parameters that are not fixed by a travel,
+// starting from the hand-picked profile; a value replaces the current one
+// only if it lowers the cost by more than min_gain, so neither ties nor
+// noise of the workload move a parameter
+static motion_profile search(const sim_workload &w, const box_model &m, const limits &l, double servo_weight){
+  int waiting_max = m.contact - l.pulse_margin < arm_move_push_max ? m.contact - l.pulse_margin : arm_move_push_max;
+  parameter params[] = {
+    {"settle", &motion_profile::settle, servo_frame, 200, grid},
+    {"push_poll", &motion_profile::push_poll, 10, 200, grid},
+    {"arm_waiting", &motion_profile::arm_waiting, arm_move_push_min, waiting_max, 10},
+    {"arm_pressed", &motion_profile::arm_pressed, m.contact + l.pulse_margin, l.pressed_max, 10},
+    {"prepare_after", &motion_profile::prepare_after, l.min_prepare, 5, 1},
+    {"follow_after", &motion_profile::follow_after, 0, 5, 1},
+  };
+  const int count = sizeof(params)/sizeof(params[0]);
+
+  motion_profile best = hand_picked;
+  for(int i=0; i<count; i++){
+    int v = best.*params[i].field;
+    if(v < params[i].lo){v = params[i].lo;}
+    if(v > params[i].hi){v = params[i].hi;}
+    best.*params[i].field = v;
+  }
+  if(best.follow_after > best.prepare_after){best.follow_after = best.prepare_after;}
+  fit_delays(best, m, l);
+  double best_cost = cost(sim_run(w, best, m), servo_weight);
+
+  for(int round=0; round<20; round++){
+    bool changed = false;
+    for(int i=0; i<count; i++){
+      for(int v=params[i].lo; v<=params[i].hi; v+=params[i].step){
+        motion_profile p = best;
+        p.*params[i].field = v;
+        fit_delays(p, m, l);
+        if(!check(p, m, l, false)){continue;}
+        double c = cost(sim_run(w, p, m), servo_weight);
+        if(c < best_cost - min_gain){
+          best = p;
+          best_cost = c;
+          changed = true;
+        }
+      }
+    }
+    fprintf(stderr, "round %d: cost %.1f\n", round+1, best_cost);
+    if(!changed){break;}
+  }
+  return best;
+}
+
+// output -------------------------------------------------------------
+
+static void print_model(FILE *out, const char *name, const servo_model &s){
+  fprintf(out, "//   %-4s %5.1f ms + %.4f ms/us, %d measurements\n", name, s.dead, s.per_us, s.samples);
+}
+
+static void print_result(FILE *out, const char *name, const sim_result &r){
+  fprintf(out, "// %-8s mean %7.1f ms  p50 %5u ms  p95 %5u ms  servo %6.1f ms per flip\n",
+          name, r.latency, r.p50, r.p95, r.servo);
+}
+
+int main(int argc, char **argv){
+  box_model m;
+  sim_default_model(m);
+  limits l = {0.2, 40, 1, arm_move_pressed_max};
+  uint32_t rng_state = 1;
+  double servo_weight = 0.1;
+  int count = 3000;
+  uint16_t th = 15;
+  bool current = false;
+  const char *trace_path = NULL;
+  const char *out_path = NULL;
+  std::vector<const char*> measure;
+
+  for(int i=1; i<argc; i++){
+    if(strcmp(argv[i], "--measure") == 0 && i+1 < argc){measure.push_back(argv[++i]);}
+    else if(strcmp(argv[i], "--trace") == 0 && i+1 < argc){trace_path = argv[++i];}
+    else if(strcmp(argv[i], "--threshold") == 0 && i+1 < argc){th = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--seed") == 0 && i+1 < argc){rng_state = strtoul(argv[++i], NULL, 10) | 1;}
+    else if(strcmp(argv[i], "--flips") == 0 && i+1 < argc){count = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--margin") == 0 && i+1 < argc){l.margin = atof(argv[++i])/100;}
+    else if(strcmp(argv[i], "--pulse-margin") == 0 && i+1 < argc){l.pulse_margin = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--min-prepare") == 0 && i+1 < argc){l.min_prepare = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--pressed-max") == 0 && i+1 < argc){l.pressed_max = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--servo-weight") == 0 && i+1 < argc){servo_weight = atof(argv[++i]);}
+    else if(strcmp(argv[i], "--current") == 0){current = true;}
+    else if(strcmp(argv[i], "-o") == 0 && i+1 < argc){out_path = argv[++i];}
+    else{
+      fprintf(stderr, "usage: %s [--measure file]... [--trace trace.bin [--threshold th]] [--seed n] [--flips n]\n"
+                      "       [--margin percent] [--pulse-margin us] [--min-prepare s] [--pressed-max us]\n"
+                      "       [--servo-weight w] [--current] [-o motion_profile.h]\n", argv[0]);
+      return 2;
+    }
+  }
+  if(l.pressed_max > arm_move_pressed_max){
+    fprintf(stderr, "--pressed-max %d us is above arm_move_pressed_max %d us of lib/BoxLogic/motion.h\n",
+            l.pressed_max, arm_move_pressed_max);
+    return 2;
+  }
+
+  std::vector<measurement> data[3], presses;
+  for(size_t i=0; i<measure.size(); i++){
+    if(!load_measurements(measure[i], data, presses, m.contact)){
+      fprintf(stderr, "cannot read %s\n", measure[i]);
+      return 1;
+    }
+  }
+  for(size_t i=0; i<presses.size(); i++){
+    if(presses[i].dist >= arm_move_push_min && presses[i].dist < m.contact){
+      measurement p = {m.contact - presses[i].dist, presses[i].ms};
+      data[1].push_back(p);
+    }
+  }
+  m.rot = fit(data[0], sim_sg90);
+  m.push = fit(data[1], sim_sg90);
+  m.lid = fit(data[2], sim_sg90);
+
+  sim_workload w;
+  if(trace_path){
+    if(!load_trace(trace_path, th, w)){
+      fprintf(stderr, "cannot read %s\n", trace_path);
+      return 1;
+    }
+  }
+  else{
+    sim_synthetic(w, count, NULL, rng_state);
+  }
+  if(w.flips.empty()){
+    fprintf(stderr, "no flips in the workload\n");
+    return 1;
+  }
+
+  sim_result before = sim_run(w, hand_picked, m);
+  if(!check(hand_picked, m, l, false)){
+    fprintf(stderr, "hand-picked profile is outside the margins of this model:\n");
+    check(hand_picked, m, l, true);
+  }
+  motion_profile p = current ? hand_picked : search(w, m, l, servo_weight);
+  sim_result after = sim_run(w, p, m);
+
+  FILE *out = stdout;
+  if(out_path){
+    out = fopen(out_path, "w");
+    if(!out){
+      perror(out_path);
+      return 1;
+    }
+  }
+  fprintf(out, "// Generated by tools/motion_tune.cpp, do not edit.\n//  ");
+  for(int i=0; i<argc; i++){
+    if(strcmp(argv[i], "-o") == 0){
+      i++;
+      continue;
+    }
+    fprintf(out, " %s", i == 0 ? "motion_tune" : argv[i]);
+  }
+  fprintf(out, "\n//\n// %d switches, %zu flips from %s\n", SWITCH_COUNT, w.flips.size(), trace_path ? trace_path : "synthetic workload");
+  fprintf(out, "// model, contact at %d us:\n", m.contact);
+  print_model(out, "rot", m.rot);
+  print_model(out, "push", m.push);
+  print_model(out, "lid", m.lid);
+  fprintf(out, "// margins: %.0f%% on travel, %d us on pulses, prepare after >= %d s\n",
+          l.margin*100, l.pulse_margin, l.min_prepare);
+  print_result(out, "before", before);
+  print_result(out, "after", after);
+  fprintf(out, "\nconstexpr motion_profile motion = {%u, %u, %u, %u, %u, %u, %u, %u, %u, %u};\n",
+          p.settle, p.slot, p.lid, p.retreat, p.push_poll, p.release,
+          p.arm_waiting, p.arm_pressed, p.follow_after, p.prepare_after);
+  if(out != stdout){fclose(out);}
+
+  fprintf(stderr, "mean latency %.1f ms -> %.1f ms, servo %.1f -> %.1f ms per flip\n",
+          before.latency, after.latency, before.servo, after.servo);
+  return 0;
+}
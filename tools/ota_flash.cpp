@@ -0,0 +1,98 @@
+// Host side of the OTA update (lib/Ota)
+//
+// build: g++ -std=c++11 -Ilib/Ota tools/ota_flash.cpp lib/Ota/ota.cpp lib/Ota/sha256.cpp -o ota_flash
+//
+// ota_flash --sha <image>
+//     prints the sha256 expected by POST /update, e.g.
+//     curl -F "image=@firmware.bin" "http://192.168.1.1/update?target=firmware&sha256=$(ota_flash --sha firmware.bin)"
+//
+// ota_flash <image> <partition.img> [size] [piece]
+//     streams image into a file-backed partition stand-in (default 1310720
+//     bytes, like app0/app1) in pieces of the given size and verifies it
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <ota.h>
+
+#include "file_region.h"
+
+static bool read_file(const char *path, std::vector<uint8_t> &data){
+  FILE *f = fopen(path, "rb");
+  if(!f){return false;}
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+    data.insert(data.end(), buffer, buffer+n);
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv){
+  if(argc == 3 && strcmp(argv[1], "--sha") == 0){
+    std::vector<uint8_t> image;
+    if(!read_file(argv[2], image)){
+      fprintf(stderr, "cannot read %s\n", argv[2]);
+      return 1;
+    }
+    sha256_ctx ctx;
+    uint8_t hash[SHA256_SIZE];
+    char hex[2*SHA256_SIZE+1];
+    sha256_init(ctx);
+    sha256_update(ctx, image.data(), image.size());
+    sha256_final(ctx, hash);
+    sha256_to_hex(hash, hex);
+    printf("%s\n", hex);
+    return 0;
+  }
+  if(argc < 3 || argc > 5){
+    fprintf(stderr, "usage: %s --sha <image>\n"
+                    "       %s <image> <partition.img> [size] [piece]\n", argv[0], argv[0]);
+    return 2;
+  }
+
+  std::vector<uint8_t> image;
+  if(!read_file(argv[1], image)){
+    fprintf(stderr, "cannot read %s\n", argv[1]);
+    return 1;
+  }
+  size_t size = argc > 3 ? strtoul(argv[3], NULL, 0) : 1310720;
+  size_t piece = argc > 4 ? strtoul(argv[4], NULL, 0) : 1436; // typical TCP segment
+  if(piece == 0){piece = 1;}
+
+  //a new partition file starts with random garbage, like used flash
+  FILE *f = fopen(argv[2], "r+b");
+  if(!f){
+    f = fopen(argv[2], "w+b");
+    if(!f){
+      fprintf(stderr, "cannot open %s\n", argv[2]);
+      return 1;
+    }
+    srand(size);
+    for(size_t i=0; i<size; i++){fputc(rand() & 0xff, f);}
+  }
+  file_region region(f, size);
+
+  uint8_t expected[SHA256_SIZE];
+  sha256_ctx ctx;
+  sha256_init(ctx);
+  sha256_update(ctx, image.data(), image.size());
+  sha256_final(ctx, expected);
+
+  static ota_writer ota;
+  ota_begin(ota, &region);
+  bool ok = true;
+  for(size_t pos=0; pos<image.size() && ok; pos+=piece){
+    size_t n = image.size() - pos < piece ? image.size() - pos : piece;
+    ok = ota_write(ota, image.data()+pos, n);
+  }
+  ok = ok && ota_finish(ota, expected);
+  fclose(f);
+
+  printf("%zu bytes, %u sector erases, %u chunk writes: %s\n",
+         ota_size(ota), region.erases, region.writes, ota_error_name(ota.error));
+  return ok ? 0 : 1;
+}
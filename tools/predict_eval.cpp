@@ -0,0 +1,165 @@
+// Host evaluation of the predictive arm positioning (lib/BoxLogic/predict.h)
+//
+// build: g++ -std=c++11 -Ilib/BoxLogic -Ilib/Trace tools/predict_eval.cpp lib/BoxLogic/box_logic.cpp
+//          lib/BoxLogic/predict.cpp lib/BoxLogic/base_sim.cpp lib/Trace/trace.cpp -o predict_eval
+//
+// predict_eval [--seed n] [--flips n] [--approach ms] [--false n] [--weights w1,w2,...]
+// predict_eval --trace trace.bin [--threshold th] [--approach ms] [--false n]
+//
+// Runs the same flips and touches through codeForBaseTask with and without
+// the model (lib/BoxLogic/base_sim.h) and reports flip-to-reset latency and
+// servo time. Delays follow the motion profile the firmware is built with,
+// servo travel the SG90 model of tools/motion_tune.cpp; "predictive" is
+// the "before" line of motion_tune --current for the same workload.
+// --approach puts the hand on the pad for ms before every flip instead of
+// the mixed touches of the synthetic workload or the trace.
+// --false adds n touches per 100 flips that are not followed by a flip
+// (a hand passing by, 0.2-2.5 s on a random pad); "wasted" is the servo
+// time spent moving towards them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <box_logic.h>
+#include <base_sim.h>
+#include <trace.h>
+
+static uint32_t rng_state = 1;
+
+static void false_touches(sim_workload &w, int per_100){
+  //spread over the whole run, skipped if they overlap a flip
+  if(w.flips.empty()){return;}
+  uint32_t first = w.flips.front().time;
+  uint32_t span = w.flips.back().time - first;
+  int count = w.flips.size() * per_100 / 100;
+  struct pass {
+    uint32_t time, length;
+    uint8_t pos;
+    static int compare(const void *a, const void *b){
+      uint32_t x = ((const pass*)a)->time, y = ((const pass*)b)->time;
+      return x < y ? -1 : x > y;
+    }
+  };
+  std::vector<pass> passes;
+  for(int k=0; k<count; k++){
+    pass p = {first + sim_rng(rng_state) % (span+1), sim_range(rng_state, 200, 2500), (uint8_t)(sim_rng(rng_state) % SWITCH_COUNT)};
+    bool overlap = false;
+    for(size_t f=0; f<w.flips.size() && !overlap; f++){
+      overlap = w.flips[f].time + 5000 > p.time && w.flips[f].time < p.time + p.length + 5000;
+    }
+    if(!overlap){passes.push_back(p);}
+  }
+  if(passes.empty()){return;}
+  qsort(passes.data(), passes.size(), sizeof(pass), pass::compare);
+  //merge them into the sorted touches of each pad
+  for(int i=0; i<SWITCH_COUNT; i++){
+    std::vector<sim_touch> touches;
+    touches.swap(w.touch[i]);
+    size_t t = 0;
+    for(size_t k=0; k<=passes.size(); k++){
+      uint32_t until = k < passes.size() ? passes[k].time : UINT32_MAX;
+      while(t < touches.size() && touches[t].start <= until){
+        sim_add_touch(w, i, touches[t].start, touches[t].end, touches[t].pass);
+        t++;
+      }
+      if(k < passes.size() && passes[k].pos == i){
+        sim_add_touch(w, i, passes[k].time, passes[k].time + passes[k].length, true);
+      }
+    }
+  }
+}
+
+static void approach_touches(sim_workload &w, uint32_t approach){
+  for(int i=0; i<SWITCH_COUNT; i++){w.touch[i].clear();}
+  for(size_t f=0; f<w.flips.size(); f++){
+    uint32_t start = w.flips[f].time > approach ? w.flips[f].time - approach : 0;
+    sim_add_touch(w, w.flips[f].pos, start, w.flips[f].time);
+  }
+}
+
+static void collect(const trace_sample &s, void *ctx){
+  sim_trace_sample(*(sim_trace*)ctx, s.time, s.switches, s.touch);
+}
+
+static bool load_trace(const char *path, uint16_t th, sim_workload &w){
+  FILE *f = fopen(path, "rb");
+  if(!f){return false;}
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+    data.insert(data.end(), buffer, buffer+n);
+  }
+  fclose(f);
+  sim_trace ctx;
+  sim_trace_init(ctx, w, th);
+  return trace_parse(data.data(), data.size(), collect, &ctx) >= 0;
+}
+
+static void report(const char *name, const sim_result &r){
+  if(!r.flips){
+    printf("%-10s no flips\n", name);
+    return;
+  }
+  printf("%-10s mean %7.1f ms  p50 %5u ms  p95 %5u ms  rotations %5u  servo %7.1f s  wasted %6.1f s\n", name,
+         r.latency, r.p50, r.p95, r.rotations, r.servo_ms/1000.0, r.wasted_ms/1000.0);
+}
+
+int main(int argc, char **argv){
+  int count = 3000;
+  uint32_t approach = 0;
+  int false_per_100 = 0;
+  uint16_t th = 15;
+  static const int skew[4] = {10, 5, 3, 1};
+  int weights[SWITCH_COUNT];
+  for(int i=0; i<SWITCH_COUNT; i++){
+    weights[i] = i < 4 ? skew[i] : 1;
+  }
+  const char *trace_path = NULL;
+
+  for(int i=1; i<argc; i++){
+    if(strcmp(argv[i], "--seed") == 0 && i+1 < argc){rng_state = strtoul(argv[++i], NULL, 10) | 1;}
+    else if(strcmp(argv[i], "--flips") == 0 && i+1 < argc){count = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--approach") == 0 && i+1 < argc){approach = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--false") == 0 && i+1 < argc){false_per_100 = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--trace") == 0 && i+1 < argc){trace_path = argv[++i];}
+    else if(strcmp(argv[i], "--threshold") == 0 && i+1 < argc){th = atoi(argv[++i]);}
+    else if(strcmp(argv[i], "--weights") == 0 && i+1 < argc){
+      char *p = argv[++i];
+      for(int k=0; k<SWITCH_COUNT; k++){
+        weights[k] = strtol(p, &p, 10);
+        if(*p == ','){p++;}
+      }
+    }
+    else{
+      fprintf(stderr, "usage: %s [--seed n] [--flips n] [--approach ms] [--false n] [--weights w1,w2,...]\n"
+                      "       [--trace trace.bin [--threshold th]]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  sim_workload w;
+  if(trace_path){
+    if(!load_trace(trace_path, th, w)){
+      fprintf(stderr, "cannot read %s\n", trace_path);
+      return 1;
+    }
+  }
+  else{
+    sim_synthetic(w, count, weights, rng_state);
+  }
+  if(approach){approach_touches(w, approach);}
+  size_t before = 0, after = 0;
+  for(int i=0; i<SWITCH_COUNT; i++){before += w.touch[i].size();}
+  false_touches(w, false_per_100);
+  for(int i=0; i<SWITCH_COUNT; i++){after += w.touch[i].size();}
+  printf("%zu flips, %zu touches, %zu false touches\n", w.flips.size(), before, after - before);
+
+  box_model m;
+  sim_default_model(m);
+  report("no model", sim_run(w, motion, m, false));
+  report("predictive", sim_run(w, motion, m, true));
+  return 0;
+}
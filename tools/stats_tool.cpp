@@ -0,0 +1,170 @@
+// Host side of the usage analytics (lib/Stats)
+//
+// build: g++ -std=c++11 -Ilib/BoxLogic -Ilib/Ota -Ilib/Stats tools/stats_tool.cpp
+//          lib/Stats/stats.cpp lib/Stats/stats_log.cpp -o stats_tool
+//
+// stats_tool dump <stats.bin>
+//     prints GET /stats.bin as json
+//
+// stats_tool read <stats.img>
+//     prints the total of a stats partition image, e.g. from
+//     esptool.py read_flash 0x3fc000 0x4000 stats.img
+//
+// stats_tool soak [flushes] [sectors]      defaults: 20000 4
+//     runs the log on a file-backed flash with random reboots and power
+//     cuts during writes and erases, checks that every reboot recovers the
+//     last complete flush and prints the erase count per sector
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <stats.h>
+#include <stats_log.h>
+
+#include "file_region.h"
+
+static void print_json(const char *text, size_t len, void *ctx){
+  fwrite(text, 1, len, (FILE*)ctx);
+}
+
+static bool read_file(const char *path, std::vector<uint8_t> &data){
+  FILE *f = fopen(path, "rb");
+  if(!f){return false;}
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+    data.insert(data.end(), buffer, buffer+n);
+  }
+  fclose(f);
+  return true;
+}
+
+static uint32_t rng = 1;
+static uint32_t random_next(uint32_t n){
+  rng = rng * 1103515245 + 12345;
+  return (rng >> 8) % n;
+}
+
+// ten minutes of a box in use
+static void simulate(stats_record &rec, stats_tracker &t, uint32_t &now){
+  switchmap_t switches = 0;
+  for(int e=random_next(12); e>0; e--){
+    int i = random_next(SWITCH_COUNT);
+    switchmap_t on = switches | 1 << (SWITCH_COUNT-1-i);
+    stats_switches(rec, t, switches, on, now);
+    if(random_next(5)){stats_reset(t, i);}
+    now += 200 + random_next(8000);
+    stats_switches(rec, t, on, switches, now);
+  }
+  stats_time(rec, t, random_next(5)*2, 600000);
+}
+
+static bool same(const stats_record &a, const stats_record &b){
+  uint8_t ea[STATS_SIZE], eb[STATS_SIZE];
+  stats_encode(a, ea);
+  stats_encode(b, eb);
+  return memcmp(ea, eb, STATS_SIZE) == 0;
+}
+
+static int soak(long flushes, int sectors){
+  FILE *f = tmpfile();
+  size_t size = sectors * 4096;
+  std::vector<uint8_t> zero(size, 0);
+  fwrite(zero.data(), 1, size, f);
+  faulty_region flash(f, size);
+
+  stats_log log;
+  stats_record base, since_boot, expected;
+  stats_tracker t;
+  if(!stats_log_open(log, &flash, base)){
+    fprintf(stderr, "region too small\n");
+    return 1;
+  }
+  stats_init(since_boot, t);
+  since_boot.boots = 1;
+  memset(&expected, 0, sizeof(expected));
+  uint32_t now = 0;
+  long reboots = 0, cuts = 0, failed = 0;
+
+  for(long i=0; i<flushes; i++){
+    simulate(since_boot, t, now);
+    stats_record total = base;
+    stats_merge(total, since_boot);
+
+    bool cut = random_next(10) == 0;
+    if(cut){
+      flash.cut = random_next(log.next % 4096 == 0 ? 4096 : STATS_ENTRY_SIZE);
+      cuts++;
+    }
+    if(stats_log_append(log, total)){
+      expected = total;
+    }
+    if(cut || random_next(8) == 0){
+      //power back: RAM counters are gone, the log has the last complete flush
+      flash.reboot();
+      reboots++;
+      stats_log_open(log, &flash, base);
+      if(!same(base, expected)){
+        failed++;
+        fprintf(stderr, "flush %ld: reboot lost the last complete flush\n", i);
+        expected = base;
+      }
+      stats_init(since_boot, t);
+      since_boot.boots = 1;
+    }
+  }
+
+  unsigned lo = flash.sector_erases[0], hi = lo;
+  for(size_t s=0; s<flash.sector_erases.size(); s++){
+    if(flash.sector_erases[s] < lo){lo = flash.sector_erases[s];}
+    if(flash.sector_erases[s] > hi){hi = flash.sector_erases[s];}
+  }
+  printf("%ld flushes, %ld reboots, %ld power cuts, %ld lost totals\n", flushes, reboots, cuts, failed);
+  printf("%d sectors, %zu entries of %d bytes per sector, erases per sector %u..%u\n",
+         sectors, (size_t)(4096 / STATS_ENTRY_SIZE), STATS_ENTRY_SIZE, lo, hi);
+  printf("total: ");
+  stats_json(expected, print_json, stdout);
+  fclose(f);
+  return failed > 0;
+}
+
+int main(int argc, char **argv){
+  if(argc >= 3 && strcmp(argv[1], "dump") == 0){
+    std::vector<uint8_t> data;
+    stats_record rec;
+    if(!read_file(argv[2], data) || !stats_decode(data.data(), data.size(), rec)){
+      fprintf(stderr, "no stats export for %d switches: %s\n", SWITCH_COUNT, argv[2]);
+      return 1;
+    }
+    stats_json(rec, print_json, stdout);
+    return 0;
+  }
+  if(argc >= 3 && strcmp(argv[1], "read") == 0){
+    FILE *f = fopen(argv[2], "rb");
+    if(!f){
+      perror(argv[2]);
+      return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    file_region flash(f, ftell(f));
+    stats_log log;
+    stats_record total;
+    if(!stats_log_open(log, &flash, total)){
+      fprintf(stderr, "image too small\n");
+      return 1;
+    }
+    fprintf(stderr, "%u valid entries, newest seq %u\n", log.entries, log.seq);
+    stats_json(total, print_json, stdout);
+    fclose(f);
+    return 0;
+  }
+  if(argc >= 2 && strcmp(argv[1], "soak") == 0){
+    long flushes = argc > 2 ? atol(argv[2]) : 20000;
+    int sectors = argc > 3 ? atoi(argv[3]) : 4;
+    return soak(flushes, sectors);
+  }
+  fprintf(stderr, "usage: stats_tool dump <stats.bin> | read <stats.img> | soak [flushes] [sectors]\n");
+  return 1;
+}
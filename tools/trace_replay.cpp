@@ -0,0 +1,175 @@
+// Host replay of sensor traces downloaded from /trace.bin
+//
+// build: g++ -std=c++11 -Ilib/BoxLogic -Ilib/Trace tools/trace_replay.cpp
+//          lib/BoxLogic/box_logic.cpp lib/Trace/trace.cpp -o trace_replay
+//
+// trace_replay <trace.bin> [th1 th2 ...]       replay through touch and base logic
+// trace_replay --csv <trace.bin>               print decoded samples
+// trace_replay --encode <in.csv> <out.bin>     encode raw samples (time,t1..tn,switches)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <box_logic.h>
+#include <trace.h>
+
+#define touch_period 5 // delay() in codeForTouchTask [ms]
+
+static const char *action_names[] = {"wait", "follow", "prepare", "idle", "reset", "done"};
+
+static bool read_file(const char *path, std::vector<uint8_t> &data){
+  FILE *f = fopen(path, "rb");
+  if(!f){return false;}
+  uint8_t buffer[4096];
+  size_t n;
+  while((n = fread(buffer, 1, sizeof(buffer), f)) > 0){
+    data.insert(data.end(), buffer, buffer+n);
+  }
+  fclose(f);
+  return true;
+}
+
+static void collect(const trace_sample &sample, void *ctx){
+  ((std::vector<trace_sample>*)ctx)->push_back(sample);
+}
+
+static void write_file(const uint8_t *data, size_t len, void *ctx){
+  fwrite(data, 1, len, (FILE*)ctx);
+}
+
+static bool load_trace(const char *path, std::vector<trace_sample> &samples){
+  std::vector<uint8_t> data;
+  if(!read_file(path, data)){
+    fprintf(stderr, "cannot read %s\n", path);
+    return false;
+  }
+  if(trace_parse(data.data(), data.size(), collect, &samples) < 0){
+    fprintf(stderr, "%s: malformed trace\n", path);
+    return false;
+  }
+  fprintf(stderr, "%s: %zu samples in %zu bytes\n", path, samples.size(), data.size());
+  return true;
+}
+
+static int print_csv(const char *path){
+  std::vector<trace_sample> samples;
+  if(!load_trace(path, samples)){return 1;}
+  for(size_t i=0; i<samples.size(); i++){
+    const trace_sample &s = samples[i];
+    printf("%u", s.time);
+    for(int c=0; c<TRACE_CHANNELS; c++){printf(",%u", s.touch[c]);}
+    printf(",%u\n", s.switches);
+  }
+  return 0;
+}
+
+static int encode(const char *in_path, const char *out_path){
+  FILE *in = fopen(in_path, "r");
+  if(!in){
+    fprintf(stderr, "cannot read %s\n", in_path);
+    return 1;
+  }
+  static trace_buffer tb;
+  trace_init(tb, 1, 0);
+  unsigned long raw = 0;
+  char line[256];
+  while(fgets(line, sizeof(line), in)){
+    trace_sample s;
+    unsigned v[TRACE_CHANNELS+2];
+    char *p = line;
+    int n;
+    for(n=0; n<TRACE_CHANNELS+2; n++){
+      char *end;
+      v[n] = strtoul(p, &end, 10);
+      if(end == p){break;}
+      p = end + (*end == ',');
+    }
+    if(n != TRACE_CHANNELS+2){continue;}
+    s.time = v[0];
+    for(int c=0; c<TRACE_CHANNELS; c++){s.touch[c] = v[c+1];}
+    s.switches = v[TRACE_CHANNELS+1];
+    trace_record(tb, s);
+    raw += TRACE_KEYFRAME_SIZE;
+  }
+  fclose(in);
+
+  FILE *out = fopen(out_path, "wb");
+  if(!out){
+    fprintf(stderr, "cannot write %s\n", out_path);
+    return 1;
+  }
+  trace_dump(tb, write_file, out);
+  fclose(out);
+  size_t size = trace_dump_size(tb);
+  if(tb.blocks > TRACE_BLOCKS){
+    fprintf(stderr, "input exceeds the ring, oldest samples dropped (%zu bytes)\n", size);
+  }
+  else{
+    fprintf(stderr, "%lu raw bytes -> %zu bytes (%.1fx)\n", raw, size, size ? (double)raw/size : 0.0);
+  }
+  return 0;
+}
+
+static int replay(const char *path, const uint16_t *th){
+  std::vector<trace_sample> samples;
+  if(!load_trace(path, samples) || samples.empty()){return 1;}
+
+  touch_pad pads[SWITCH_COUNT] = {};
+  uint16_t status[SWITCH_COUNT] = {};
+  int rot_pos = 0;
+  base_step last = {0xff, 0xff};
+
+  trace_sample s = samples[0];
+  uint32_t now = s.time;
+  for(size_t i=0; i<samples.size(); i++){
+    //hold the last values between records like the touch task would see them
+    for(; now < samples[i].time; now += touch_period){
+      for(int c=0; c<SWITCH_COUNT; c++){
+        status[c] = touch_update(pads[c], status[c], s.touch[c], th[c], now);
+      }
+    }
+    s = samples[i];
+    now = s.time;
+    for(int c=0; c<SWITCH_COUNT; c++){
+      status[c] = touch_update(pads[c], status[c], s.touch[c], th[c], now);
+    }
+
+    base_step step = base_decide(s.switches, status, rot_pos);
+    if(step.action != last.action || step.target != last.target){
+      printf("%10u ms  switches ", s.time);
+      for(int c=0; c<SWITCH_COUNT; c++){printf("%d", (s.switches>>(SWITCH_COUNT-1-c))&1);}
+      printf("  touch");
+      for(int c=0; c<SWITCH_COUNT; c++){printf(" %u", status[c]);}
+      printf("  -> %s", action_names[step.action]);
+      if(step.action == BASE_FOLLOW || step.action == BASE_PREPARE || step.action == BASE_RESET){
+        printf(" %d", step.target+1);
+        rot_pos = step.target;
+      }
+      printf("\n");
+      last = step;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv){
+  if(argc == 3 && strcmp(argv[1], "--csv") == 0){
+    return print_csv(argv[2]);
+  }
+  if(argc == 4 && strcmp(argv[1], "--encode") == 0){
+    return encode(argv[2], argv[3]);
+  }
+  if(argc == 2 || argc == 2+SWITCH_COUNT){
+    uint16_t th[SWITCH_COUNT];
+    for(int i=0; i<SWITCH_COUNT; i++){
+      th[i] = i+2 < argc ? atoi(argv[i+2]) : 15; // config_default "normal"
+    }
+    return replay(argv[1], th);
+  }
+  fprintf(stderr, "usage: %s <trace.bin> [th1 th2 ...]\n"
+                  "       %s --csv <trace.bin>\n"
+                  "       %s --encode <in.csv> <out.bin>\n", argv[0], argv[0], argv[0]);
+  return 2;
+}